@@ -0,0 +1,20 @@
+#!/bin/bash
+# Milliseconds spent locating DCs (stage "dcs", see -v 5) summed over each
+# corpus in tests/, best of RUNS runs, e.g. to compare lookups in descr2.sdf
+RUNS=${RUNS:-5}
+echo "corpus,molecules,dcs,all stages"
+for d in tests/*/MOL
+do
+        CORPUS=$(basename $(dirname $d))
+        FILES=$(ls $d/*.MOL | wc -l)
+        BEST=""
+        for r in $(seq $RUNS)
+        do
+                MS=$(fcss-2a -t 1 -v 5 --format=csv $d/*.MOL 2>&1 >/dev/null | grep "^Stage" \
+                        | awk '$2 == "dcs:" { dcs += $3 } { all += $3 } END { printf "%.1f,%.1f", dcs, all }')
+                if [ -z "$BEST" ] || awk "BEGIN{ exit !(${MS%,*} < ${BEST%,*}) }"; then
+                        BEST=$MS
+                fi
+        done
+        echo "$CORPUS,$FILES,$BEST"
+done
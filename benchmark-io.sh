@@ -0,0 +1,21 @@
+#!/bin/bash
+# Files per second on list.txt for each way of reading MOL files (see --io)
+# with cold and warm page cache, cold runs need root to drop caches
+TIMEFORMAT="%R";
+FILES=$(wc -l < list.txt)
+echo "io,cache,threads,seconds,files/s"
+for io in mmap threads uring
+do
+    for t in 1 4 8
+    do
+        for cache in cold warm
+        do
+            if [ $cache = cold ]; then
+                sync
+                { echo 3 > /proc/sys/vm/drop_caches; } 2>/dev/null || continue
+            fi
+            TIME=$( { time fcss-2a -t $t --io $io --list list.txt > /dev/null 2>&1; } 2>&1 )
+            echo "$io,$cache,$t,$TIME,$(awk "BEGIN{ printf \"%.0f\", $FILES / $TIME }")"
+        done
+    done
+done
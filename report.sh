@@ -2,6 +2,7 @@
 
 echo "Выборка,Соединений,Общие Дескрипторы,Только в ФКСП-2А,Только в ФКСП-2"
 for t in tests/* ; do
+	[ -f $t/fcss-2.csv ] || continue # no fcss-2 output to compare with
 	MOLS=`find $t/MOL -name '*.MOL' | wc -l`
 	DATA=`fcss-comp -i $t/fcss-2.csv $t/fcss-2a.csv |  grep -A 5 "SUMMARY" | tail -3`
 	COUNTS=`echo "$DATA" | cut -f2 -d ':'`
@@ -0,0 +1,12 @@
+#!/bin/bash
+# Time encoding stages of each molecule in a directory (large V3000 set by default)
+# CSV: molecule, atoms, bonds, then milliseconds spent in each stage
+# MATCHER=vf2 times replacement descriptors found the old way (see --matcher)
+DIR=${1:-extra-tests/Large/MOL}
+echo "molecule,atoms,bonds,prepare,cycles,dcs,cyclic,linear,replacement"
+for f in `find $DIR -name '*.MOL' | sort`
+do
+        COUNTS=`grep -m 1 "^M  V30 COUNTS" $f | awk '{print $4","$5}'`
+        STAGES=`fcss-2a -v 5 ${MATCHER:+--matcher $MATCHER} --format=csv $f 2>&1 >/dev/null | grep "^Stage" | awk '{printf ",%s", $3}'`
+        echo "$(basename $f .MOL),$COUNTS$STAGES"
+done
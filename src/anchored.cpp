@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <queue>
+#include <boost/graph/vf2_sub_graph_iso.hpp>
+#include "anchored.hpp"
+#include "descriptors.hpp"
+
+using namespace std;
+using namespace boost;
+
+namespace {
+
+// piece vertices breadth-first from a1 and the neighbor each one is found
+// around, neighbors go by code and bound type so that similar pieces grow
+// the same way; false if some vertex can't be reached
+bool growthOrder(const Replacement& r, vector<vd>& sequence, vector<vd>& parent)
+{
+    auto& p = r.piece;
+    size_t n = num_vertices(p);
+    sequence.clear();
+    parent.assign(n, 0);
+    if(r.a1 < 0 || (size_t)r.a1 >= n)
+        return false;
+    vector<bool> seen(n);
+    queue<vd> next;
+    next.push(r.a1);
+    seen[r.a1] = true;
+    vector<pair<pair<int, int>, vd>> around;
+    while(!next.empty())
+    {
+        vd u = next.front();
+        next.pop();
+        sequence.push_back(u);
+        around.clear();
+        for(auto e : make_iterator_range(out_edges(u, p)))
+            if(!seen[target(e, p)])
+                around.push_back(make_pair(make_pair(p[target(e, p)].code.code(), p[e].type), target(e, p)));
+        sort(around.begin(), around.end());
+        for(auto& a : around)
+        {
+            seen[a.second] = true;
+            parent[a.second] = u;
+            next.push(a.second);
+        }
+    }
+    if(sequence.size() == n)
+        return true;
+    sequence.clear();
+    return false;
+}
+
+// Order in which vf2_subgraph_iso picks piece vertices: the first one in
+// vertex_order_by_mult next to those already matched, if any. It finds
+// mappings sorted by atoms they take in this order
+vector<vd> vf2Sequence(const ChemGraph& p, const vector<vd>& order)
+{
+    size_t n = num_vertices(p);
+    vector<bool> matched(n), next(n);
+    vector<vd> sequence;
+    while(sequence.size() < n)
+    {
+        bool anyNext = false;
+        for(auto v : order)
+            anyNext = anyNext || (next[v] && !matched[v]);
+        for(auto v : order)
+        {
+            if(matched[v] || (anyNext && !next[v]))
+                continue;
+            matched[v] = true;
+            sequence.push_back(v);
+            for(auto w : make_iterator_range(adjacent_vertices(v, p)))
+                next[w] = true;
+            break;
+        }
+    }
+    return sequence;
+}
+
+// callback of vf2_graph_iso of a piece onto itself, collects all but the identity
+struct CollectSymmetries{
+    const ChemGraph& p;
+    vector<vector<vd>>& found;
+
+    template<class Map1To2, class Map2To1>
+    bool operator()(Map1To2 f, Map2To1)const
+    {
+        vector<vd> sigma;
+        bool identity = true;
+        for(auto v : make_iterator_range(vertices(p)))
+        {
+            sigma.push_back(get(f, v));
+            identity = identity && sigma.back() == v;
+        }
+        if(!identity)
+            found.push_back(std::move(sigma));
+        return true;
+    }
+};
+
+const int wildCodes[PieceNeeds::wildcards] = { Z_code, R_code, X_code, Y1_code };
+
+// every atom 'label' matches is matched by 'wildcard' too; atoms first seen
+// later are neither C, H nor O, so all wildcards match them
+bool within(Code label, Code wildcard)
+{
+    if(!label.isWild())
+        return wildcard.matches(label);
+    for(int c = 0; c < Code::atoms(); c++)
+        if(label.matches(Code(c)) && !wildcard.matches(Code(c)))
+            return false;
+    return true;
+}
+
+struct AnchoredSearch{
+    const Replacement& r;
+    const PiecePlan& plan;
+    const ChemGraph& g;
+    const vector<bool>& anchor;
+    vector<vd>& mapped;   // piece vertex -> atom
+    Mappings& mappings;
+
+    bool fits(size_t k, vd b)const
+    {
+        auto& p = r.piece;
+        auto& sequence = plan.growth;
+        vd u = sequence[k];
+        if(!plan.labels[u].matches(g[b].code))
+            return false;
+        if(plan.anchors[u] && !anchor[b])
+            return false;
+        // bounds to matched vertices are the same both ways (induced subgraph)
+        for(size_t t = 0; t < k; t++)
+        {
+            vd w = mapped[sequence[t]];
+            if(w == b)
+                return false;
+            auto pe = edge(u, sequence[t], p);
+            auto ge = edge(b, w, g);
+            if(pe.second != ge.second)
+                return false;
+            if(pe.second && p[pe.first].type != g[ge.first].type)
+                return false;
+        }
+        return true;
+    }
+
+    void match(size_t k)
+    {
+        auto& sequence = plan.growth;
+        if(k == sequence.size())
+        {
+            if(plan.canonical(mapped))
+            {
+                auto& m = mappings.add(mapped.size());
+                copy(mapped.begin(), mapped.end(), m.begin());
+            }
+            return;
+        }
+        vd u = sequence[k];
+        if(k == 0)
+        {
+            for(auto b : make_iterator_range(vertices(g)))
+                if(anchor[b] && fits(k, b))
+                {
+                    mapped[u] = b;
+                    match(k + 1);
+                }
+            return;
+        }
+        for(auto b : make_iterator_range(adjacent_vertices(mapped[plan.parent[u]], g)))
+            if(fits(k, b))
+            {
+                mapped[u] = b;
+                match(k + 1);
+            }
+    }
+};
+
+}
+
+PieceNeeds::PieceNeeds(const Replacement& r):anchors(0)
+{
+    auto& p = r.piece;
+    fill(wild, wild + wildcards, 0);
+    fill(bounds, bounds + boundTypes, 0);
+    for(auto v : make_iterator_range(vertices(p)))
+    {
+        Code c = p[v].code;
+        if(!c.isWild())
+        {
+            auto it = find_if(atoms.begin(), atoms.end(), [&](const pair<int, uint32_t>& a){
+                return a.first == c.code();
+            });
+            if(it == atoms.end())
+                atoms.emplace_back(c.code(), 1);
+            else
+                it->second++;
+        }
+        for(size_t w = 0; w < wildcards; w++)
+            if(within(c, Code(wildCodes[w])))
+                wild[w]++;
+        if((int)v == r.a1 || (int)v == r.a2)
+            anchors++;
+    }
+    sort(atoms.begin(), atoms.end());
+    for(auto e : make_iterator_range(edges(p)))
+        if(p[e].type >= 0 && (size_t)p[e].type < boundTypes)
+            bounds[p[e].type]++;
+}
+
+void MoleculeCounts::count(const ChemGraph& g, const vector<bool>& anchor)
+{
+    atoms.assign(Code::atoms(), 0);
+    wildAtoms = 0;
+    anchors = 0;
+    fill(wild, wild + PieceNeeds::wildcards, 0);
+    fill(bounds, bounds + PieceNeeds::boundTypes, 0);
+    for(auto v : make_iterator_range(vertices(g)))
+    {
+        Code c = g[v].code;
+        if(c.isWild())
+            wildAtoms++;
+        else
+        {
+            if((size_t)c.code() >= atoms.size())
+                atoms.resize(c.code() + 1);
+            atoms[c.code()]++;
+            for(size_t w = 0; w < PieceNeeds::wildcards; w++)
+                if(Code(wildCodes[w]).matches(c))
+                    wild[w]++;
+        }
+        if(anchor[v])
+            anchors++;
+    }
+    for(auto e : make_iterator_range(edges(g)))
+        if(g[e].type >= 0 && (size_t)g[e].type < PieceNeeds::boundTypes)
+            bounds[g[e].type]++;
+}
+
+bool MoleculeCounts::has(const PieceNeeds& needs)const
+{
+    if(anchors < needs.anchors)
+        return false;
+    for(size_t b = 0; b < PieceNeeds::boundTypes; b++)
+        if(bounds[b] < needs.bounds[b])
+            return false;
+    // an atom with a wildcard code may stand for any vertex
+    for(size_t w = 0; w < PieceNeeds::wildcards; w++)
+        if(wild[w] + wildAtoms < needs.wild[w])
+            return false;
+    for(auto& a : needs.atoms)
+    {
+        uint32_t have = (size_t)a.first < atoms.size() ? atoms[a.first] : 0;
+        if(have + wildAtoms < a.second)
+            return false;
+    }
+    return true;
+}
+
+PiecePlan::PiecePlan(const Replacement& r):
+    vf2Order(vertex_order_by_mult(r.piece)), sequence(vf2Sequence(r.piece, vf2Order)), needs(r)
+{
+    auto& p = r.piece;
+    growthOrder(r, growth, parent);
+    for(auto v : make_iterator_range(vertices(p)))
+    {
+        labels.push_back(p[v].code);
+        anchors.push_back((int)v == r.a1 || (int)v == r.a2);
+    }
+    vf2_graph_iso(p, p, CollectSymmetries{ p, symmetries }, vf2Order,
+        vertices_equivalent([&](vd a, vd b){
+            return labels[a] == labels[b] && ((int)a == r.a1) == ((int)b == r.a1)
+                && ((int)a == r.a2) == ((int)b == r.a2);
+        }).edges_equivalent([&](ed a, ed b){
+            return p[a].type == p[b].type;
+        }));
+}
+
+bool PiecePlan::canonical(const vector<size_t>& m)const
+{
+    // a copy m[sigma[v]] that VF2 would find first
+    for(auto& sigma : symmetries)
+        for(auto v : sequence)
+        {
+            if(m[sigma[v]] != m[v])
+            {
+                if(m[sigma[v]] < m[v])
+                    return false;
+                break;
+            }
+        }
+    return true;
+}
+
+void Mappings::sortAsVf2(const PiecePlan& plan)
+{
+    auto& sequence = plan.sequence;
+    sort(begin(), end(), [&](const vector<size_t>& a, const vector<size_t>& b){
+        for(auto v : sequence)
+            if(a[v] != b[v])
+                return a[v] < b[v];
+        return false;
+    });
+}
+
+bool anchoredMatches(const Replacement& r, const PiecePlan& plan, const ChemGraph& g,
+    const vector<bool>& anchor, vector<vd>& work, Mappings& mappings)
+{
+    if(plan.growth.empty())
+        return false;
+    mappings.clear();
+    work.resize(plan.growth.size());
+    AnchoredSearch search{ r, plan, g, anchor, work, mappings };
+    search.match(0);
+    mappings.sortAsVf2(plan);
+    return true;
+}
+
+ReplacementTrie::ReplacementTrie(const vector<Replacement>& repls, const vector<PiecePlan>& plans):
+    stepVertices(repls.size()), pieces(repls.size()), depth(0)
+{
+    for(size_t i = 0; i < repls.size(); i++)
+    {
+        auto& p = repls[i].piece;
+        auto& plan = plans[i];
+        auto& sequence = plan.growth;
+        if(sequence.empty())
+            continue;
+        vector<int> stepOf(num_vertices(p));
+        for(size_t k = 0; k < sequence.size(); k++)
+            stepOf[sequence[k]] = k;
+        int at = -1; // node of the last step, -1 before the first one
+        auto children = [&]() -> vector<uint32_t>& {
+            return at < 0 ? roots : nodes[at].children;
+        };
+        for(size_t k = 0; k < sequence.size(); k++)
+        {
+            vd u = sequence[k];
+            Step step{ plan.labels[u], plan.anchors[u], k ? stepOf[plan.parent[u]] : -1, {} };
+            for(auto e : make_iterator_range(out_edges(u, p)))
+                if(stepOf[target(e, p)] < (int)k)
+                    step.bounds.emplace_back(stepOf[target(e, p)], p[e].type);
+            sort(step.bounds.begin(), step.bounds.end());
+            auto& level = children();
+            auto same = find_if(level.begin(), level.end(), [&](uint32_t n){
+                return nodes[n].step == step;
+            });
+            if(same != level.end())
+            {
+                at = *same;
+                continue;
+            }
+            uint32_t n = nodes.size();
+            nodes.push_back(Node{ step, {}, {} });
+            children().push_back(n);
+            at = n;
+        }
+        nodes[at].ends.push_back(i);
+        stepVertices[i] = sequence;
+        depth = max(depth, sequence.size());
+    }
+}
+
+struct ReplacementTrie::Search{
+    const ReplacementTrie& trie;
+    const ChemGraph& g;
+    const vector<bool>& anchor;
+    const vector<PiecePlan>& plans;
+    const vector<bool>& wanted;
+    const vector<bool>& live;
+    vector<vd>& mapped; // atom of each step
+    vector<Mappings>& mappings;
+
+    bool fits(const Step& s, size_t k, vd b)const
+    {
+        if(!s.code.matches(g[b].code))
+            return false;
+        if(s.anchor && !anchor[b])
+            return false;
+        // bounds to earlier steps are just those of the step (induced subgraph)
+        auto bound = s.bounds.begin();
+        for(size_t t = 0; t < k; t++)
+        {
+            vd w = mapped[t];
+            if(w == b)
+                return false;
+            auto ge = edge(b, w, g);
+            bool bounded = bound != s.bounds.end() && bound->first == (int)t;
+            if(bounded != ge.second)
+                return false;
+            if(bounded && g[ge.first].type != (bound++)->second)
+                return false;
+        }
+        return true;
+    }
+
+    // 'node' is matched as step k
+    void match(uint32_t node, size_t k)
+    {
+        auto& n = trie.nodes[node];
+        for(auto piece : n.ends)
+        {
+            if(!wanted[piece])
+                continue;
+            auto& vertices = trie.stepVertices[piece];
+            auto& m = mappings[piece].add(vertices.size());
+            for(size_t t = 0; t < vertices.size(); t++)
+                m[vertices[t]] = mapped[t];
+            if(!plans[piece].canonical(m))
+                mappings[piece].pop();
+        }
+        for(auto c : n.children)
+        {
+            if(!live[c])
+                continue;
+            auto& s = trie.nodes[c].step;
+            for(auto b : make_iterator_range(adjacent_vertices(mapped[s.parent], g)))
+                if(fits(s, k + 1, b))
+                {
+                    mapped[k + 1] = b;
+                    match(c, k + 1);
+                }
+        }
+    }
+};
+
+void ReplacementTrie::find(const ChemGraph& g, const vector<bool>& anchor, const vector<PiecePlan>& plans,
+    const vector<bool>& wanted, vector<bool>& live, vector<vd>& work, vector<Mappings>& mappings)const
+{
+    mappings.resize(pieces);
+    for(auto& m : mappings)
+        m.clear();
+    // children come after their parents
+    live.assign(nodes.size(), false);
+    for(size_t n = nodes.size(); n-- > 0; )
+    {
+        for(auto piece : nodes[n].ends)
+            live[n] = live[n] || wanted[piece];
+        for(auto c : nodes[n].children)
+            live[n] = live[n] || live[c];
+    }
+    work.resize(depth);
+    Search search{ *this, g, anchor, plans, wanted, live, work, mappings };
+    for(auto b : make_iterator_range(vertices(g)))
+    {
+        if(!anchor[b])
+            continue;
+        for(auto r : roots)
+            if(live[r] && search.fits(nodes[r].step, 0, b))
+            {
+                search.mapped[0] = b;
+                search.match(r, 0);
+            }
+    }
+    for(size_t i = 0; i < pieces; i++)
+        if(compiled(i))
+            mappings[i].sortAsVf2(plans[i]);
+}
@@ -0,0 +1,135 @@
+// Replacement pieces matched from their anchor atoms outward, see FCSP::replacement
+#pragma once
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include "chemgraph.hpp"
+
+struct Replacement;
+
+// What a piece needs of a molecule to be found in it: atoms of each code,
+// atoms of each wildcard class, bounds of each type and atoms A1 and A2
+// may go to. A molecule that has fewer of any of them is not searched
+struct PieceNeeds{
+    static const size_t wildcards = 4;  // Z, R, X and Y1
+    static const size_t boundTypes = 8; // bounds of other types are not counted
+    std::vector<std::pair<int, uint32_t>> atoms; // codes the piece has, by code
+    uint32_t wild[wildcards];  // vertices that only go to atoms matching each wildcard
+    uint32_t bounds[boundTypes];
+    uint32_t anchors;
+
+    explicit PieceNeeds(const Replacement& r);
+};
+
+// The same counted over a molecule, once before its replacements
+struct MoleculeCounts{
+    std::vector<uint32_t> atoms; // by code
+    uint32_t wildAtoms;          // atoms with wildcard codes, they may match any vertex
+    uint32_t wild[PieceNeeds::wildcards];
+    uint32_t bounds[PieceNeeds::boundTypes];
+    uint32_t anchors;
+
+    void count(const ChemGraph& g, const std::vector<bool>& anchor);
+    bool has(const PieceNeeds& needs)const;
+};
+
+// What matching a piece takes that doesn't depend on the molecule,
+// made once when the DB is loaded (see DescriptorDB::prepare)
+struct PiecePlan{
+    std::vector<vd> vf2Order;  // vertex_order_by_mult of the piece, for vf2_subgraph_iso
+    std::vector<vd> sequence;  // order VF2 matches vertices in, mappings come sorted by it
+    std::vector<vd> growth;    // vertices breadth-first from a1, empty if the piece is not connected
+    std::vector<vd> parent;    // neighbor each vertex is found around while growing
+    std::vector<Code> labels;  // code of each vertex
+    std::vector<bool> anchors; // a1 and a2, only go to anchor atoms
+    // automorphisms of the piece that keep a1 and a2 in place, but the identity;
+    // mappings they turn one into another take the same atoms for the same anchors
+    std::vector<std::vector<vd>> symmetries;
+    PieceNeeds needs;
+
+    explicit PiecePlan(const Replacement& r);
+    // 'm' is the first of its symmetric copies in the order VF2 finds them,
+    // others give nothing new to the output
+    bool canonical(const std::vector<size_t>& m)const;
+};
+
+// Mappings piece vertex -> atom, vectors are kept on clear() to be reused
+// for the next molecule
+class Mappings{
+public:
+    typedef std::vector<std::vector<size_t>>::iterator iterator;
+    Mappings():count(0){}
+    void clear(){ count = 0; }
+    std::vector<size_t>& add(size_t vertices)
+    {
+        if(count == rows.size())
+            rows.emplace_back();
+        auto& row = rows[count++];
+        row.resize(vertices);
+        return row;
+    }
+    // the last one added is dropped
+    void pop(){ count--; }
+    size_t size()const{ return count; }
+    iterator begin(){ return rows.begin(); }
+    iterator end(){ return rows.begin() + count; }
+    // sorted in the order vf2_subgraph_iso finds them
+    void sortAsVf2(const PiecePlan& plan);
+private:
+    std::vector<std::vector<size_t>> rows;
+    size_t count;
+};
+
+// Every induced subgraph of 'g' isomorphic to the piece of 'r', with a1 and a2
+// on atoms marked in 'anchor', as mappings piece vertex -> atom of 'g'.
+// Finds the same mappings as vf2_subgraph_iso with the same equivalence of
+// atoms and bounds and in the same order, but the search starts only at
+// anchor atoms. False if the piece is not connected and can't be grown this way.
+// 'work' is scratch for the mapping being built
+bool anchoredMatches(const Replacement& r, const PiecePlan& plan, const ChemGraph& g,
+    const std::vector<bool>& anchor, std::vector<vd>& work, Mappings& mappings);
+
+// All replacement pieces compiled into one trie of the steps anchoredMatches
+// would take, i.e. atoms added one at a time from a1 with their bounds to
+// the ones before. Pieces that start the same way share their first steps,
+// so a molecule is searched once for all of them
+class ReplacementTrie{
+public:
+    ReplacementTrie():pieces(0), depth(0){}
+    ReplacementTrie(const std::vector<Replacement>& repls, const std::vector<PiecePlan>& plans);
+    // mappings of each piece, the same as anchoredMatches finds; pieces
+    // that are not compiled are left empty
+    // 'wanted' are pieces to look for, steps that lead to none of them are
+    // skipped; 'live' is scratch for those steps that do
+    void find(const ChemGraph& g, const std::vector<bool>& anchor, const std::vector<PiecePlan>& plans,
+        const std::vector<bool>& wanted, std::vector<bool>& live, std::vector<vd>& work,
+        std::vector<Mappings>& mappings)const;
+    // false for pieces that are not connected, see anchoredMatches
+    bool compiled(size_t piece)const{ return !stepVertices[piece].empty(); }
+    size_t size()const{ return pieces; }
+    size_t steps()const{ return nodes.size(); }
+private:
+    struct Step{
+        Code code;
+        bool anchor;       // a1 or a2 that only go to anchor atoms
+        int parent;        // step whose atom's neighbors are tried, -1 for a1
+        std::vector<std::pair<int, int>> bounds; // all bounds to earlier steps and their types
+        bool operator==(const Step& rhs)const
+        {
+            return code == rhs.code && anchor == rhs.anchor && parent == rhs.parent && bounds == rhs.bounds;
+        }
+    };
+    struct Node{
+        Step step;
+        std::vector<uint32_t> children;
+        std::vector<uint32_t> ends; // pieces that are complete at this step
+    };
+    struct Search;
+    friend struct TrieSource; // writes the trie as C++ code, see generated.cpp
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> roots;
+    std::vector<std::vector<vd>> stepVertices; // piece vertex of each step
+    size_t pieces;
+    size_t depth; // steps of the longest piece
+};
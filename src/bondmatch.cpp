@@ -0,0 +1,67 @@
+#include "bondmatch.hpp"
+
+void BondMatcher::reset(size_t rows_)
+{
+    rows = rows_;
+    for(size_t i = 0; i < rows; i++)
+        adj[i] = 0;
+}
+
+static size_t lowestBit(uint64_t x)
+{
+    return __builtin_ctzll(x);
+}
+
+// Kuhn's step: find a column for 'row', moving rows that own columns it
+// could take to their other columns
+bool BondMatcher::augment(size_t row, uint64_t used, uint64_t& visited, int* owner)const
+{
+    for(uint64_t avail = adj[row] & ~used & ~visited; avail; avail &= avail - 1)
+    {
+        size_t col = lowestBit(avail);
+        visited |= uint64_t(1) << col;
+        if(owner[col] < 0 || augment(owner[col], used, visited, owner))
+        {
+            owner[col] = (int)row;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BondMatcher::feasible(size_t row, uint64_t used)const
+{
+    int owner[maxBounds];
+    for(size_t i = 0; i < maxBounds; i++)
+        owner[i] = -1;
+    for(size_t r = row; r < rows; r++)
+    {
+        uint64_t visited = 0;
+        if(!augment(r, used, visited, owner))
+            return false;
+    }
+    return true;
+}
+
+bool BondMatcher::first(size_t* selection)const
+{
+    if(!feasible(0, 0))
+        return false;
+    uint64_t used = 0;
+    for(size_t r = 0; r < rows; r++)
+    {
+        // the lowest column that leaves the rest matchable, there is one
+        // as the rows from r on are feasible with 'used' taken
+        for(uint64_t avail = adj[r] & ~used; avail; avail &= avail - 1)
+        {
+            size_t col = lowestBit(avail);
+            if(feasible(r + 1, used | (uint64_t(1) << col)))
+            {
+                selection[r] = col;
+                used |= uint64_t(1) << col;
+                break;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+// Matching of pattern bounds to bounds around an atom, see locateDCs
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Picks a distinct column (bound of the atom) for each row (bound of a
+// pattern) out of the columns allowed for that row, rows are bitsets so
+// there may be up to 64 of either. Runs in polynomial time, checking that
+// rows left can still be matched by augmenting paths instead of backtracking,
+// and keeps all state in the object so that it allocates nothing
+class BondMatcher{
+public:
+    static const size_t maxBounds = 64;
+
+    BondMatcher():rows(0){}
+    // new matrix with nothing allowed, rows and columns up to maxBounds
+    void reset(size_t rows_);
+    void allow(size_t row, size_t col){ adj[row] |= uint64_t(1) << col; }
+    // the lexicographically first assignment (the lowest column for the first
+    // row and so on), 'selection' gets column of each row; false if there is none
+    bool first(size_t* selection)const;
+private:
+    // rows from 'row' on can get distinct columns that are not in 'used'
+    bool feasible(size_t row, uint64_t used)const;
+    bool augment(size_t row, uint64_t used, uint64_t& visited, int* owner)const;
+
+    uint64_t adj[maxBounds];
+    size_t rows;
+};
@@ -1,6 +1,7 @@
 // Std
 #include <algorithm>
 #include <deque>
+#include <numeric>
 #include <unordered_map>
 // Boost
 #include <boost/graph/graphviz.hpp>
@@ -32,6 +33,32 @@ ChemGraph toGraph(CTab& tab)
     return graph;
 }
 
+GraphSink::GraphSink(ChemGraph& graph_):
+    graph(graph_)
+{
+    graph.clear();
+}
+
+void GraphSink::counts(int atoms, int bounds, int atomLists, int chiral)
+{
+    graph.m_vertices.reserve(atoms);
+}
+
+void GraphSink::atom(const AtomEntry& atom)
+{
+    add_vertex(AtomVertex(atom.code), graph);
+}
+
+void GraphSink::bound(const BoundEntry& bound)
+{
+    add_edge(bound.a1 - 1, bound.a2 - 1, Bound(bound.type), graph);
+}
+
+Code& GraphSink::code(size_t atom)
+{
+    return graph[atom].code;
+}
+
 int getValence(ChemGraph& graph, ChemGraph::vertex_descriptor vertex)
 {
     auto edges = out_edges(vertex, graph);
@@ -34,6 +34,19 @@ using vd = ChemGraph::vertex_descriptor;
 using ed = ChemGraph::edge_descriptor;
 
 ChemGraph toGraph(CTab& tab);
+
+// Builds the graph right as a MOL file is read, the same one toGraph
+// would make of its CTab. 'graph' is cleared and refilled so that
+// the memory it holds is reused for the next molecule.
+struct GraphSink : MolSink{
+    ChemGraph& graph;
+
+    explicit GraphSink(ChemGraph& graph);
+    void counts(int atoms, int bounds, int atomLists, int chiral) override;
+    void atom(const AtomEntry& atom) override;
+    void bound(const BoundEntry& bound) override;
+    Code& code(size_t atom) override;
+};
 ChemGraph& addHydrogen(ChemGraph& graph);
 int getValence(ChemGraph& graph, ChemGraph::vertex_descriptor vertex);
 void dumpGraph(ChemGraph& graph, std::ostream& out);
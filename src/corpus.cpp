@@ -0,0 +1,162 @@
+#include <string.h>
+#include "corpus.hpp"
+#include "sections.hpp"
+
+using namespace std;
+using boost::string_ref;
+
+void error(const string& msg);
+
+static const char corpusMagic[8] = { 'F', 'C', 'S', 'S', 'P', 'A', 'C', 'K' };
+static const uint32_t corpusVersion = 1;
+
+// section offsets from the start of file
+struct CorpusLayout{
+    uint64_t symbols, index, atoms, bounds, charges, names;
+    bool valid; // sections fit in the file and fill it up
+
+    CorpusLayout(const CorpusHeader& h, uint64_t size)
+    {
+        FileSections s(sizeof(CorpusHeader), size);
+        symbols = s.section(h.symbolBytes, 1);
+        index = s.section(h.molecules, sizeof(CorpusEntry), 1);
+        atoms = s.section(h.atoms, sizeof(int32_t));
+        bounds = s.section(h.bounds, 3 * sizeof(int32_t));
+        charges = s.section(h.atoms, 1);
+        names = s.section(h.nameBytes, 1);
+        valid = s.exact();
+    }
+};
+
+CorpusWriter::CorpusWriter():
+    index(1, CorpusEntry{0, 0, 0}){}
+
+void CorpusWriter::add(const ChemGraph& graph, const string& name)
+{
+    for(auto v : boost::make_iterator_range(vertices(graph)))
+    {
+        Code code = graph[v].code;
+        auto& sym = code.symbol();
+        auto it = symbolIndex.find(sym);
+        if(it == symbolIndex.end())
+        {
+            it = symbolIndex.insert(make_pair(sym, (int32_t)symbols.size())).first;
+            symbols.push_back(sym);
+        }
+        if(code.charge() < INT8_MIN || code.charge() > INT8_MAX)
+            error("charge out of range in " + name);
+        atoms.push_back(it->second);
+        charges.push_back(code.charge());
+    }
+    for(auto e : boost::make_iterator_range(edges(graph)))
+    {
+        bounds.push_back(source(e, graph));
+        bounds.push_back(target(e, graph));
+        bounds.push_back(graph[e].type);
+    }
+    names += name;
+    index.push_back(CorpusEntry{atoms.size(), bounds.size() / 3, names.size()});
+}
+
+void CorpusWriter::write(ostream& out)const
+{
+    string symbolBytes;
+    for(auto& s : symbols)
+    {
+        symbolBytes += s;
+        symbolBytes += '\0';
+    }
+    CorpusHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, corpusMagic, sizeof(corpusMagic));
+    header.version = corpusVersion;
+    header.symbolBytes = symbolBytes.size();
+    header.molecules = size();
+    header.atoms = atoms.size();
+    header.bounds = bounds.size() / 3;
+    header.nameBytes = names.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(out, sizeof(header));
+    out.write(symbolBytes.data(), symbolBytes.size());
+    pad(out, symbolBytes.size());
+    auto section = [&out](const void* data, uint64_t size){
+        out.write(static_cast<const char*>(data), size);
+        pad(out, size);
+    };
+    section(index.data(), index.size() * sizeof(CorpusEntry));
+    section(atoms.data(), atoms.size() * sizeof(int32_t));
+    section(bounds.data(), bounds.size() * sizeof(int32_t));
+    section(charges.data(), charges.size());
+    out.write(names.data(), names.size());
+}
+
+bool Corpus::matches(const char* data, size_t size)
+{
+    return size >= sizeof(corpusMagic) && memcmp(data, corpusMagic, sizeof(corpusMagic)) == 0;
+}
+
+Corpus::Corpus(const string& path):
+    file(path)
+{
+    const char* base = file.data();
+    if(file.size() < sizeof(CorpusHeader) || !matches(base, file.size()))
+        error("'" + path + "' is not a molecule corpus");
+    header = reinterpret_cast<const CorpusHeader*>(base);
+    if(header->version != corpusVersion)
+        error("'" + path + "' has unsupported corpus version " + to_string(header->version));
+    CorpusLayout layout(*header, file.size());
+    if(!layout.valid)
+        error("'" + path + "' is truncated or corrupted");
+    index = reinterpret_cast<const CorpusEntry*>(base + layout.index);
+    atoms = reinterpret_cast<const int32_t*>(base + layout.atoms);
+    bounds = reinterpret_cast<const int32_t*>(base + layout.bounds);
+    charges = reinterpret_cast<const int8_t*>(base + layout.charges);
+    names = base + layout.names;
+    const CorpusEntry& last = index[header->molecules];
+    if(last.atom != header->atoms || last.bound != header->bounds || last.name != header->nameBytes)
+        error("'" + path + "' has inconsistent index");
+    // symbols are looked up once, new ones get registered like in MOL files
+    const char* sym = base + layout.symbols;
+    const char* end = sym + header->symbolBytes;
+    while(sym < end)
+    {
+        size_t len = strnlen(sym, end - sym);
+        codes.push_back(Code(string(sym, len)));
+        sym += len + 1;
+    }
+}
+
+string_ref Corpus::name(size_t i)const
+{
+    const CorpusEntry& first = index[i];
+    const CorpusEntry& next = index[i + 1];
+    if(first.name > next.name || next.name > header->nameBytes)
+        error("corrupted corpus entry " + to_string(i));
+    return string_ref(names + first.name, next.name - first.name);
+}
+
+ChemGraph Corpus::graph(size_t i)const
+{
+    const CorpusEntry& first = index[i];
+    const CorpusEntry& next = index[i + 1];
+    if(first.atom > next.atom || first.bound > next.bound || next.atom > header->atoms || next.bound > header->bounds)
+        error("corrupted corpus entry " + to_string(i));
+    size_t count = next.atom - first.atom;
+    ChemGraph graph(count);
+    for(size_t a = 0; a < count; a++)
+    {
+        auto sym = atoms[first.atom + a];
+        if(sym < 0 || sym >= (int32_t)codes.size())
+            error("corrupted corpus entry " + to_string(i));
+        Code code = codes[sym];
+        code.charge(charges[first.atom + a]);
+        graph[a] = AtomVertex(code);
+    }
+    for(auto b = bounds + first.bound * 3; b != bounds + next.bound * 3; b += 3)
+    {
+        if(b[0] < 0 || b[1] < 0 || (size_t)b[0] >= count || (size_t)b[1] >= count)
+            error("corrupted corpus entry " + to_string(i));
+        add_edge(b[0], b[1], Bound(b[2]), graph);
+    }
+    return graph;
+}
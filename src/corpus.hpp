@@ -0,0 +1,75 @@
+// Binary corpus of molecules pre-parsed into flat arrays, see `fcss-2a pack`.
+// Encoding a corpus skips text parsing altogether, the file is memory mapped
+// and shared as is by all worker threads
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <stdint.h>
+#include <boost/utility/string_ref.hpp>
+#include "chemgraph.hpp"
+#include "mapped.hpp"
+
+// Layout, native byte order, each section starts at a multiple of 8 bytes:
+//   header
+//   symbols  - 0-terminated atom symbols, atoms refer to them by number
+//   index    - (molecules + 1) offsets of the first atom, bound and name
+//              of each molecule, the last one holds the totals
+//   atoms    - int32 symbol numbers
+//   bounds   - int32 triples: atom, atom (within the molecule), bound type
+//   charges  - int8 per atom
+//   names    - molecule names back to back
+struct CorpusHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t symbolBytes;
+    uint64_t molecules;
+    uint64_t atoms;
+    uint64_t bounds;
+    uint64_t nameBytes;
+};
+
+struct CorpusEntry{
+    uint64_t atom, bound, name;
+};
+
+// Collects molecules in memory and writes them out as a corpus
+class CorpusWriter{
+public:
+    CorpusWriter();
+    // vertices and edges are stored in graph order so that encoding
+    // the corpus gives the same output as encoding the source
+    void add(const ChemGraph& graph, const std::string& name);
+    size_t size()const{ return index.size() - 1; }
+    void write(std::ostream& out)const;
+private:
+    std::vector<std::string> symbols;
+    std::map<std::string, int32_t> symbolIndex;
+    std::vector<CorpusEntry> index;
+    std::vector<int32_t> atoms;
+    std::vector<int32_t> bounds;
+    std::vector<int8_t> charges;
+    std::string names;
+};
+
+// Read-only view of a corpus file, safe to use from many threads
+class Corpus{
+public:
+    // throws std::logic_error if it's not a valid corpus
+    explicit Corpus(const std::string& path);
+    size_t size()const{ return header->molecules; }
+    boost::string_ref name(size_t i)const;
+    ChemGraph graph(size_t i)const;
+    // true if 'data' starts as a corpus file
+    static bool matches(const char* data, size_t size);
+private:
+    MappedFile file;
+    const CorpusHeader* header;
+    const CorpusEntry* index;
+    const int32_t* atoms;
+    const int32_t* bounds;
+    const int8_t* charges;
+    const char* names;
+    std::vector<Code> codes; // by symbol number
+};
@@ -6,6 +6,7 @@
 #include <string>
 #include <ctype.h>
 #include <cmath>
+#include <limits>
 #include <string.h>
 #include "ctab.hpp"
 #include "parser.hpp"
@@ -23,52 +24,220 @@ void warning(const string& msg)
     LOG(WARN) << msg.c_str() << endline;
 }
 
-const char* fetchSpec(const char* fmt, FormatSpec& spec)
+// MOL V2000 line layouts, see Layout<> in parser.hpp
+struct CountsLine{
+    static constexpr const char* format = "aaabbblllfffcccsssxxxrrrpppiiimmmvvvvvv";
+};
+
+struct AtomLine{
+    static constexpr const char* format = "xxxxx.xxxxyyyyy.yyyyzzzzz.zzzz aaaddcccssshhhbbbvvvHHHrrriiimmmnnneee";
+};
+
+struct BoundLine{
+    static constexpr const char* format = "111222tttsssxxxrrrccc";
+};
+
+// leading parts of the above that encoding needs, the rest of line is not looked at
+struct AtomSymbolLine{
+    static constexpr const char* format = "xxxxx.xxxxyyyyy.yyyyzzzzz.zzzz aaa";
+};
+
+struct BoundTypeLine{
+    static constexpr const char* format = "111222tttsss";
+};
+
+// V3000 logical line without "M  V30 " prefix,
+// a line ending with '-' is continued on the next one
+static string v30line(Parser& parser)
 {
-    char marker = *fmt;
-    if (!marker)
-        error("extra arguments in format string");
-    //parse the width-pattern
-    if (isalpha(marker) || isdigit(marker))
+    string result;
+    for(;;)
     {
-        // an alpha repeated n times            
-        const char* q = fmt;
-        while (*++fmt == marker){}
-        //fmt is next char
-        auto n = fmt - q;
-        //folowed by dot ? 
-        if (*fmt == '.')
+        if(parser.eof())
+            error("unexpected end of file in V3000 CTAB");
+        auto s = parser.line();
+        if(!s.starts_with("M  V30 "))
+            error("expected 'M  V30' line:" + s.to_string());
+        s.remove_prefix(7);
+        if(!s.empty() && s.back() == '-')
         {
-            ++fmt;
-            if (*fmt != marker)
-                error("format error - expected same alpha after '.'");
-            const char* q = fmt;
-            while (*++fmt == marker){}
-            auto m = fmt - q;
-            spec.n = n;
-            spec.m = m;
+            s.remove_suffix(1);
+            result.append(s.data(), s.size());
         }
         else
         {
-            spec.n = n;
-            spec.m = 0;
+            result.append(s.data(), s.size());
+            return result;
         }
     }
-    else
+}
+
+// split V3000 line on blanks, "quoted" and (parenthesized) values are kept whole
+static void v30split(const string& line, vector<string_ref>& tokens)
+{
+    tokens.clear();
+    const char* p = line.data();
+    const char* end = p + line.size();
+    for(;;)
     {
-        spec.n = 0;
-        spec.m = 0;
+        while(p < end && *p == ' ')
+            p++;
+        if(p == end)
+            break;
+        const char* start = p;
+        bool quoted = false;
+        int depth = 0;
+        for(; p < end && (quoted || depth || *p != ' '); p++)
+        {
+            if(*p == '"')
+                quoted = !quoted;
+            else if(!quoted && *p == '(')
+                depth++;
+            else if(!quoted && *p == ')')
+                depth--;
+        }
+        tokens.push_back(string_ref(start, p - start));
     }
-    return fmt;
 }
 
-CTab readMol(Parser& parser)
+static int v30int(string_ref s)
+{
+    int value = 0;
+    bool negative = !s.empty() && s.front() == '-';
+    if(negative)
+        s.remove_prefix(1);
+    if(s.empty())
+        error("V3000 - expected a number");
+    for(char c : s)
+    {
+        if(c < '0' || c > '9')
+            error("V3000 - expected digit:" + string(1, c));
+        if(value > (numeric_limits<int>::max() - (c - '0')) / 10)
+            error("V3000 - number out of range:" + s.to_string());
+        value = value * 10 + c - '0';
+    }
+    return negative ? -value : value;
+}
+
+static double v30double(string_ref s)
+{
+    string tmp = s.to_string();
+    char* stop;
+    double value = strtod(tmp.c_str(), &stop);
+    if(tmp.empty() || *stop)
+        error("V3000 - expected a number:" + tmp);
+    return value;
+}
+
+// value of KEY=value in tokens past the positional fields, empty if missing
+static string_ref v30prop(const vector<string_ref>& tokens, size_t from, string_ref key)
+{
+    for(size_t i = from; i < tokens.size(); i++)
+    {
+        auto& t = tokens[i];
+        if(t.size() > key.size() && t.starts_with(key) && t[key.size()] == '=')
+            return t.substr(key.size() + 1);
+    }
+    return string_ref();
+}
+
+// V3000 CTAB block from "BEGIN CTAB" to "END CTAB"
+// atoms and bounds are passed on the same way as in V2000,
+// returns the number of atoms
+static size_t readV3000(Parser& parser, MolSink& sink, MolFields fields, int atomLists)
+{
+    if(v30line(parser) != "BEGIN CTAB")
+        error("V3000 - expected BEGIN CTAB");
+    vector<string_ref> tokens; // point into 'line'
+    //COUNTS na nb nsg n3d chiral [REGNO=regno]
+    auto line = v30line(parser);
+    v30split(line, tokens);
+    if(tokens.size() < 6 || tokens[0] != "COUNTS")
+        error("V3000 - bad COUNTS line");
+    // the sink reserves room for the counts, each atom and bound takes
+    // an 'M  V30 ' line so there can't be more than what is left has room for
+    int na = v30int(tokens[1]), nb = v30int(tokens[2]);
+    if(na < 0 || nb < 0 || (size_t)na + nb > parser.left() / 7)
+        error("V3000 - bad COUNTS line");
+    sink.counts(na, nb, atomLists, v30int(tokens[5]));
+    size_t atoms = 0, bounds = 0;
+    map<int, int> index; // V3000 atom index -> 1-based position
+    for(;;)
+    {
+        line = v30line(parser);
+        if(line == "END CTAB")
+            break;
+        if(line == "BEGIN ATOM")
+        {
+            for(line = v30line(parser); line != "END ATOM"; line = v30line(parser))
+            {
+                //index type x y z aamap [CHG=val] ...
+                v30split(line, tokens);
+                if(tokens.size() < 6)
+                    error("V3000 - bad atom line:" + line);
+                auto type = tokens[1];
+                if(type.size() > 1 && type.front() == '"' && type.back() == '"')
+                    type = type.substr(1, type.size() - 2);
+                if(type.starts_with("[") || type.starts_with("NOT"))
+                    error("V3000 - atom lists are not supported");
+                Code code(type.to_string());
+                auto chg = v30prop(tokens, 6, "CHG");
+                if(!chg.empty())
+                {
+                    code.charge(v30int(chg));
+                    LOG(INFO) << "Found charge on "<< code.symbol()<< " = "<< code.charge() <<endline;
+                }
+                if(fields == TOPOLOGY)
+                    sink.atom(AtomEntry(0, 0, 0, 0, code));
+                else
+                    sink.atom(AtomEntry(v30double(tokens[2]),
+                        v30double(tokens[3]), v30double(tokens[4]), 0, code));
+                index[v30int(tokens[0])] = ++atoms;
+            }
+        }
+        else if(line == "BEGIN BOND")
+        {
+            for(line = v30line(parser); line != "END BOND"; line = v30line(parser))
+            {
+                //index type atom1 atom2 [CFG=val] ...
+                v30split(line, tokens);
+                if(tokens.size() < 4)
+                    error("V3000 - bad bond line:" + line);
+                int type = v30int(tokens[1]);
+                auto a1 = index.find(v30int(tokens[2]));
+                auto a2 = index.find(v30int(tokens[3]));
+                if(a1 == index.end() || a2 == index.end())
+                    error("bad bounds indices - out of range.");
+                // CFG to V2000 stereo: 1 - up, 2 - either, 3 - down
+                int stereo = 0;
+                auto cfg = v30prop(tokens, 4, "CFG");
+                if(!cfg.empty())
+                {
+                    int c = v30int(cfg);
+                    if(type == DOUBLE)
+                        stereo = c == 2 ? 3 : 0;
+                    else
+                        stereo = c == 1 ? 1 : c == 2 ? 4 : c == 3 ? 6 : 0;
+                }
+                sink.bound(BoundEntry(a1->second, a2->second, type | (stereo*STEREO)));
+                bounds++;
+            }
+        }
+        else if(line.compare(0, 6, "BEGIN ") == 0)
+        {
+            // collections, S-groups etc. don't affect the graph
+            auto stop = "END " + line.substr(6);
+            while(v30line(parser) != stop){}
+        }
+    }
+    if(atoms != (size_t)na || bounds != (size_t)nb)
+        warning("V3000 - COUNTS don't match atom and bond blocks");
+    return atoms;
+}
+
+// everything past the header block
+static void readMol(Parser& parser, MolSink& sink, MolFields fields)
 {
-    CTab tab;
-    //MOL Header
-    tab.name = parser.line();
-    tab.descr = parser.line();
-    tab.comment = parser.line();
     //The Counts Line
     //aaabbblllfffcccsssxxxrrrpppiiimmmvvvvvv
     //aaa = number of atoms (current max 255)* [Generic]
@@ -85,75 +254,156 @@ CTab readMol(Parser& parser)
     // No longer supported, the default is set to 999.
     int aaa, bbb, lll, fff, ccc, sss, xxx, rrr, ppp, iii, mmm;
     char ver[8];
-    parser.matchfln("aaabbblllfffcccsssxxxrrrpppiiimmmvvvvvv", aaa, bbb, lll, fff,
+    parser.matchfln<CountsLine>(aaa, bbb, lll, fff,
         ccc, sss, xxx, rrr, ppp, iii, mmm, ver);
-    tab.chiral = ccc;
-    tab.atomLists = lll;
-    if(strcmp(ver, "V2000") != 0)
+    // V3000 keeps atoms and bounds in its own CTAB block
+    bool v3000 = strcmp(ver, "V3000") == 0;
+    if(v3000)
+        aaa = bbb = 0;
+    else if(strcmp(ver, "V2000") != 0)
         warning("counts line has wrong version:"+string(ver));
-    tab.atoms = vector<AtomEntry>(aaa);
+    sink.counts(aaa, bbb, lll, ccc);
     for(int i=0; i<aaa; i++)
     {
         //atom line
         //xxxxx.xxxxyyyyy.yyyyzzzzz.zzzz aaaddcccssshhhbbbvvvHHHrrriiimmmnnneee
-        double x, y, z;
+        double x = 0, y = 0, z = 0;
         char symbol[4] = { 0 }; //aaa
-        int ddd, ccc, sss, hhh, bbb, vvv, HHH, rrr, iii, mmm, nnn, eee;
-        parser.matchfln("xxxxx.xxxxyyyyy.yyyyzzzzz.zzzz aaaddcccssshhhbbbvvvHHHrrriiimmmnnneee",
-            x, y, z, symbol, ddd, ccc, sss, hhh, bbb, vvv, HHH,
-            rrr, iii, mmm, nnn, eee);
+        int ddd, ccc, sss, hhh = 0, bbb, vvv, HHH, rrr, iii, mmm, nnn, eee;
+        if(fields == TOPOLOGY)
+        {
+            Skip skip;
+            parser.matchfln<AtomSymbolLine>(skip, skip, skip, symbol);
+        }
+        else
+            parser.matchfln<AtomLine>(x, y, z, symbol, ddd, ccc, sss, hhh, bbb, vvv, HHH,
+                rrr, iii, mmm, nnn, eee);
         auto white = find(symbol, symbol + 4, ' ');
         if (white != symbol + 4)
             *white = 0;
         Code code(symbol);
-        tab.atoms[i] = AtomEntry(x, y, z, hhh, code);
+        sink.atom(AtomEntry(x, y, z, hhh, code));
     }
-    tab.bounds = vector<BoundEntry>(bbb);
     for(int i=0; i<bbb; i++)
     {
         //bound line
         //111222tttsssxxxrrrccc
         int first, second;
         int ttt, sss, xxx, rrr, ccc;
-        parser.matchfln("111222tttsssxxxrrrccc", first, second,
-            ttt, sss, xxx, rrr, ccc);
-        if(first < 0 || second < 0 ||
-                first > (int)tab.atoms.size() || second > (int)tab.atoms.size())
+        if(fields == TOPOLOGY)
+            parser.matchfln<BoundTypeLine>(first, second, ttt, sss);
+        else
+            parser.matchfln<BoundLine>(first, second,
+                ttt, sss, xxx, rrr, ccc);
+        if(first < 1 || second < 1 ||
+                first > aaa || second > aaa)
             error("bad bounds indices - out of range.");
-        tab.bounds[i] = BoundEntry(first, second, ttt | (sss*STEREO));
+        sink.bound(BoundEntry(first, second, ttt | (sss*STEREO)));
     }
+    // atoms added so far, for checking charge records
+    size_t atoms = aaa;
+    if(v3000)
+        atoms = readV3000(parser, sink, fields, lll);
     // old-style properties M  PROP_NAME ......
     for(;;)
     {
         auto s = parser.line();
-        if(s.size() > 6 && s.substr(0, 6) == "M  CHG")
+        if(s.size() > 6 && s.starts_with("M  CHG"))
         {
-            istringstream iss(s.substr(6)); // continue parsing
+            istringstream iss(s.substr(6).to_string()); // continue parsing
             // FIXME: cross fingers and pray that charge and atom count doesn't go up to 100+
             int a, b, c;
             iss >> a >> b >> c;
             b -= 1;
-            if(b >= tab.atoms.size() || b < 0)
+            if(b >= (int)atoms || b < 0)
                 error("bad charge record - atom number out of range");
-            tab.atoms[b].code.charge(c);
-            LOG(INFO) << "Found charge on "<<tab.atoms[b].code.symbol()<< " = "<< c <<endline;
+            Code& code = sink.code(b);
+            code.charge(c);
+            LOG(INFO) << "Found charge on "<<code.symbol()<< " = "<< c <<endline;
         }
         else if(s == "M  END" || parser.eof())
             break;
         // cout << "Skipping: " << s << endline;
     }
+}
+
+namespace {
+
+// fills CTab as the MOL file is read
+struct CTabSink : MolSink{
+    CTab& tab;
+
+    explicit CTabSink(CTab& tab_): tab(tab_){}
+
+    void counts(int atoms, int bounds, int atomLists, int chiral) override
+    {
+        tab.atoms.reserve(atoms);
+        tab.bounds.reserve(bounds);
+        tab.atomLists = atomLists;
+        tab.chiral = chiral;
+    }
+
+    void atom(const AtomEntry& atom) override
+    {
+        tab.atoms.push_back(atom);
+    }
+
+    void bound(const BoundEntry& bound) override
+    {
+        tab.bounds.push_back(bound);
+    }
+
+    Code& code(size_t atom) override
+    {
+        return tab.atoms[atom].code;
+    }
+};
+
+}
+
+CTab readMol(Parser& parser, MolFields fields)
+{
+    CTab tab;
+    //MOL Header
+    tab.name = parser.line().to_string();
+    tab.descr = parser.line().to_string();
+    tab.comment = parser.line().to_string();
+    CTabSink sink(tab);
+    readMol(parser, sink, fields);
     return tab;
 }
 
-CTab readMol(istream& inp)
+// MOL header block, not kept
+static void skipHeader(Parser& parser)
+{
+    for(int i = 0; i < 3; i++)
+        parser.line();
+}
+
+CTab readMol(istream& inp, MolFields fields)
 {
     Parser parser(inp);
-    return readMol(parser);
+    return readMol(parser, fields);
 }
 
-void writefln(ostream& out, const char* fmt)
+CTab readMol(const char* data, size_t size, MolFields fields)
 {
-    out << fmt << endline;
+    Parser parser(data, size);
+    return readMol(parser, fields);
+}
+
+void readMol(istream& inp, MolSink& sink, MolFields fields)
+{
+    Parser parser(inp);
+    skipHeader(parser);
+    readMol(parser, sink, fields);
+}
+
+void readMol(const char* data, size_t size, MolSink& sink, MolFields fields)
+{
+    Parser parser(data, size);
+    skipHeader(parser);
+    readMol(parser, sink, fields);
 }
 
 template<class A>
@@ -168,88 +418,96 @@ void write(ostream& out, double a, int n, int m)
         << setprecision(m) << setiosflags(ios::fixed) << a;
 }
 
-template<class F, class ...T>
-void writefln(ostream& out, const char* fmt, F front, T... tail)
+template<class L, int I>
+void writeFields(ostream& out)
+{
+    out << endline;
+}
+
+template<class L, int I, class F, class ...T>
+void writeFields(ostream& out, F front, T... tail)
 {
-    while(*fmt)
+    const Column& col = L::columns[I];
+    out.write(L::format + col.offset - col.lead, col.lead);
+    if (col.m)
+        write(out, front, col.n, col.m);
+    else
     {
-        FormatSpec spec;
-        fmt = fetchSpec(fmt, spec);
-        if (spec.n)
-        {
-            if (spec.m)
-            {
-                write(out, front, spec.n, spec.m);                
-            }
-            else
-            {
-                out.width(spec.n);
-                out << front;
-            }
-            return writefln(out, fmt, tail...);
-        }
-        else
-            out << (char)*fmt;
-        fmt++;
+        out.width(col.n);
+        out << front;
     }
+    writeFields<L, I + 1>(out, tail...);
+}
+
+// write a line of Fmt format
+template<class Fmt, class ...T>
+void writefln(ostream& out, T... values)
+{
+    typedef Layout<Fmt> L;
+    static_assert(sizeof...(T) == L::size, "number of values must match fields in the format");
+    writeFields<L, 0>(out, values...);
 }
 
 void writeMol(CTab& tab, ostream& out)
 {
     out << tab.name << endline << tab.descr << endline << tab.comment << endline;
     //aaabbblllfffcccsssxxxrrrpppiiimmmvvvvvv
-    writefln(out, "aaabbblllfffcccsssxxxrrrpppiiimmmvvvvvv", 
+    writefln<CountsLine>(out, 
         tab.atoms.size(), tab.bounds.size(), tab.atomLists, 
         0, tab.chiral, 0, 0, 0, 0, 0, 999, "V2000");
     for (auto &e : tab.atoms)
     {
-        writefln(out, "xxxxx.xxxxyyyyy.yyyyzzzzz.zzzz aaaddcccssshhhbbbvvvHHHrrriiimmmnnneee",
-            e.x, e.y, e.z, e.code.symbol(), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        writefln<AtomLine>(out, e.x, e.y, e.z, e.code.symbol(), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
     }
     for (auto &e : tab.bounds)
     {
-        writefln(out, "111222tttsssxxxrrrccc", e.a1, e.a2, e.type, 0, 0, 0, 0);
+        writefln<BoundLine>(out, e.a1, e.a2, e.type, 0, 0, 0, 0);
     }
     out << "M  END" << endline;
 }
 
-vector<SDF> readSdf(Parser& parser)
+// read properties of a single record up to and including '$$$$'
+void readSdfProps(Parser& parser, SdfProps& props)
 {
-    vector<SDF> ret;
-    while(!parser.eof())
+    for(;;)
     {
-        SDF sdf;
-        sdf.mol = readMol(parser);
-        // read properties
+        if(parser.eof()) //no properties
+            break;
+        auto line = parser.line().to_string();
+        if(line == "$$$$")
+            break;
+        //> <property_name>
+        if(line[0] != '>')
+            error("SDF property is expected to start with >:"+line);
+        auto left = line.find('<', 1);
+        if(left == string::npos)
+            error("expected '<' before property name");
+        auto right = line.find('>', left+1);
+        if(right == string::npos)
+            error("expected '>' after property name");
+        auto name = line.substr(left+1, right-left-1);
+        props[name] = vector<string>();
+        auto& target = props[name];
+        // read property lines
         for(;;)
         {
-            if(parser.eof()) //no properties
-                break;
-            auto line = parser.line();
-            if(line == "$$$$")
+            line = parser.line().to_string();
+            //empty line breaks property value list
+            if(line.empty())
                 break;
-            //> <property_name>
-            if(line[0] != '>')
-                error("SDF property is expected to start with >:"+line);
-            auto left = line.find('<', 1);
-            if(left == string::npos)
-                error("expected '<' before property name");
-            auto right = line.find('>', left+1);
-            if(right == string::npos)
-                error("expected '>' after property name");
-            auto name = line.substr(left+1, right-left-1);
-            sdf.props[name] = vector<string>();
-            auto& target = sdf.props[name];
-            // read property lines
-            for(;;)
-            {
-                line = parser.line();
-                //empty line breaks property value list
-                if(line.empty())
-                    break;
-                target.push_back(std::move(line));
-            }
+            target.push_back(std::move(line));
         }
+    }
+}
+
+vector<SDF> readSdf(Parser& parser)
+{
+    vector<SDF> ret;
+    while(!parser.eof())
+    {
+        SDF sdf;
+        sdf.mol = readMol(parser, ALL_FIELDS);
+        readSdfProps(parser, sdf.props);
         ret.push_back(std::move(sdf));
     }
     return ret;
@@ -260,3 +518,180 @@ vector<SDF> readSdf(std::istream& inp)
     Parser parser(inp);
     return readSdf(parser);
 }
+
+// true if [p, end) starts with a '$$$$' line
+static bool isSeparator(const char* p, const char* end)
+{
+    if(end - p < 4 || memcmp(p, "$$$$", 4) != 0)
+        return false;
+    p += 4;
+    if(p != end && *p == '\r')
+        p++;
+    return p == end || *p == '\n';
+}
+
+// past the first '$$$$' line at or after 'from' or 'end' if there is none,
+// 'data' is the start of the text so that 'from' may point mid-line
+static const char* recordEnd(const char* data, const char* from, const char* end)
+{
+    // '$' is rare in SDF so memchr (vectorized in libc) skips most of the text
+    for(const char* p = from; p < end; p++)
+    {
+        p = static_cast<const char*>(memchr(p, '$', end - p));
+        if(!p)
+            break;
+        if((p == data || p[-1] == '\n') && isSeparator(p, end))
+        {
+            auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            return eol ? eol + 1 : end;
+        }
+    }
+    return end;
+}
+
+// nothing but whitespace left i.e. no more records
+static bool blank(const char* p, const char* end)
+{
+    for(; p < end; p++)
+        if(!isspace((unsigned char)*p))
+            return false;
+    return true;
+}
+
+vector<TextChunk> splitSdf(const char* data, size_t size, size_t target)
+{
+    vector<TextChunk> chunks;
+    const char* end = data + size;
+    const char* p = data;
+    while(p < end)
+    {
+        const char* stop = (size_t)(end - p) > target ? recordEnd(data, p + target, end) : end;
+        chunks.push_back(TextChunk{p, (size_t)(stop - p)});
+        p = stop;
+    }
+    return chunks;
+}
+
+size_t countSdfRecords(const char* data, size_t size)
+{
+    const char* end = data + size;
+    size_t n = 0;
+    for(const char* p = data; !blank(p, end); n++)
+        p = recordEnd(data, p, end);
+    return n;
+}
+
+size_t sdfRecordSize(const char* data, size_t size)
+{
+    const char* end = data + size;
+    return blank(data, end) ? 0 : recordEnd(data, data, end) - data;
+}
+
+// next line of [p, end) without line break, 'p' is moved past it
+static string_ref nextLine(const char*& p, const char* end)
+{
+    const char* start = p;
+    auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    p = eol ? eol + 1 : end;
+    const char* stop = eol ? eol : end;
+    if(stop != start && stop[-1] == '\r')
+        stop--;
+    return string_ref(start, stop - start);
+}
+
+string sdfProperty(const char* record, size_t size, const string& name)
+{
+    const char* p = record;
+    const char* end = record + size;
+    // properties follow the MOL block
+    while(p < end && nextLine(p, end) != "M  END"){}
+    while(p < end)
+    {
+        auto line = nextLine(p, end);
+        if(line.empty() || line.front() != '>')
+            continue;
+        // > <property_name> as in readSdfProps
+        auto left = line.find('<');
+        if(left == string_ref::npos)
+            continue;
+        auto rest = line.substr(left + 1);
+        auto right = rest.find('>');
+        if(right == string_ref::npos || rest.substr(0, right) != name)
+            continue;
+        return p < end ? nextLine(p, end).to_string() : string();
+    }
+    return string();
+}
+
+SdfReader::SdfReader(istream& inp, MolFields fields_):
+    inp(&inp), cur(nullptr), end(nullptr), parser(new Parser(nullptr, 0)), records(0), fields(fields_){}
+
+SdfReader::SdfReader(const char* data, size_t size, size_t first, MolFields fields_):
+    inp(nullptr), cur(data), end(data + size), parser(new Parser(nullptr, 0)), records(first), fields(fields_){}
+
+// buffer one record from the stream up to and including '$$$$'
+bool SdfReader::fill()
+{
+    buf.clear();
+    if(inp->bad()) // read error was already thrown to the caller
+        return false;
+    string line;
+    bool content = false;
+    while(getline(*inp, line))
+    {
+        buf += line;
+        buf += '\n';
+        if(!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if(line == "$$$$")
+            return true;
+        content = content || !blank(line.data(), line.data() + line.size());
+    }
+    return content;
+}
+
+// parser set to the next record, false if there are no more
+bool SdfReader::nextRecord()
+{
+    // each record is parsed on its own so a malformed one
+    // can't run into the next
+    if(inp)
+    {
+        if(!fill())
+            return false;
+        parser->reset(buf.data(), buf.size());
+    }
+    else
+    {
+        if(blank(cur, end))
+            return false;
+        auto stop = recordEnd(cur, cur, end);
+        parser->reset(cur, stop - cur);
+        cur = stop;
+    }
+    records++;
+    return true;
+}
+
+bool SdfReader::next(SDF& sdf)
+{
+    if(!nextRecord())
+        return false;
+    sdf.props.clear();
+    sdf.mol = readMol(*parser, fields);
+    readSdfProps(*parser, sdf.props);
+    return true;
+}
+
+bool SdfReader::next(MolSink& mol, SdfProps& props)
+{
+    if(!nextRecord())
+        return false;
+    props.clear();
+    skipHeader(*parser);
+    readMol(*parser, mol, fields);
+    readSdfProps(*parser, props);
+    return true;
+}
+
+SdfReader::~SdfReader(){}
@@ -10,9 +10,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <istream>
 #include <ostream>
 #include "periodic.hpp"
+#include "mapped.hpp"
 
 enum {
     SINGLE = 1,
@@ -56,12 +58,80 @@ struct CTab{
         name(), descr(), comment(), atomLists(0), chiral(0), atoms(), bounds(){}
 };
 
+typedef std::map<std::string, std::vector<std::string>> SdfProps;
+
 //a single entry of SDF database file
 struct SDF{
     CTab mol;
-    std::map<std::string, std::vector<std::string>> props;
+    SdfProps props;
+};
+
+// what readMol fills in
+enum MolFields{
+    ALL_FIELDS, // everything that's kept in CTab e.g. to be written back with writeMol
+    TOPOLOGY    // atoms, charges and bounds only for encoding, coordinates are left 0
+                // and unused columns are not converted nor checked
 };
 
-CTab readMol(std::istream& inp);
+struct Parser;
+
+// Receives atoms, bounds and charges of a MOL file as they are parsed so that
+// they go straight into the structure the caller needs (see CTab, GraphSink).
+// Bounds come after all the atoms they refer to.
+struct MolSink{
+    // sizes from the counts line, for V3000 called once more with its COUNTS
+    virtual void counts(int atoms, int bounds, int atomLists, int chiral) = 0;
+    virtual void atom(const AtomEntry& atom) = 0;
+    // atom positions are 1-based and already checked to be in range
+    virtual void bound(const BoundEntry& bound) = 0;
+    // code of an atom added before by its 0-based position, to set the charge
+    virtual Code& code(size_t atom) = 0;
+    virtual ~MolSink(){}
+};
+
+// Reads SDF records one at a time, only the current record is kept in memory
+class SdfReader{
+public:
+    // buffers one record at a time from the stream
+    SdfReader(std::istream& inp, MolFields fields = ALL_FIELDS);
+    // parses in place, 'data' must outlive the reader,
+    // 'first' is the number of records preceding 'data' (see splitSdf)
+    SdfReader(const char* data, size_t size, size_t first = 0, MolFields fields = ALL_FIELDS);
+    // parse next record into 'sdf', false if there are no more records
+    // a malformed record is skipped up to its '$$$$' and exception rethrown
+    bool next(SDF& sdf);
+    // same but the molecule goes to 'mol', header block is not kept
+    bool next(MolSink& mol, SdfProps& props);
+    // number of records read so far, including malformed ones
+    size_t count()const{ return records; }
+    ~SdfReader();
+private:
+    bool fill();
+    bool nextRecord();
+    std::istream* inp;
+    const char* cur;
+    const char* end;
+    std::string buf;
+    std::unique_ptr<Parser> parser;
+    size_t records;
+    MolFields fields;
+};
+
+CTab readMol(std::istream& inp, MolFields fields = ALL_FIELDS);
+CTab readMol(const char* data, size_t size, MolFields fields = ALL_FIELDS);
+// atoms, bounds and charges into 'sink', header block is skipped
+void readMol(std::istream& inp, MolSink& sink, MolFields fields = TOPOLOGY);
+void readMol(const char* data, size_t size, MolSink& sink, MolFields fields = TOPOLOGY);
 void writeMol(CTab& tab, std::ostream& out);
 std::vector<SDF> readSdf(std::istream& inp);
+
+// split SDF text into chunks of about 'target' bytes on '$$$$' boundaries
+std::vector<TextChunk> splitSdf(const char* data, size_t size, size_t target);
+// number of records SdfReader would find in 'data'
+size_t countSdfRecords(const char* data, size_t size);
+// size of the record at 'data' up to and including its '$$$$' line,
+// 0 if nothing but whitespace is left, records follow one another
+// the same way SdfReader reads them
+size_t sdfRecordSize(const char* data, size_t size);
+// first value line of property 'name' of a single record, empty if missing
+std::string sdfProperty(const char* record, size_t size, const std::string& name);
@@ -0,0 +1,270 @@
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <boost/filesystem.hpp>
+#include "dbimage.hpp"
+#include "mapped.hpp"
+#include "sections.hpp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+void error(const string& msg);
+
+static const char imageMagic[8] = { 'F', 'C', 'S', 'S', 'D', 'E', 'S', 'C' };
+static const uint32_t imageVersion = 1;
+
+const char* const descriptorImageName = "descr.bin";
+
+// section offsets from the start of file
+struct DbImageLayout{
+    uint64_t symbols, codes, levelOne, levelTwo, links, replacements, atoms, bounds;
+    bool valid; // sections fit in the file and fill it up
+
+    DbImageLayout(const DbImageHeader& h, uint64_t size)
+    {
+        FileSections s(sizeof(DbImageHeader), size);
+        symbols = s.section(h.symbolBytes, 1);
+        codes = s.section(h.symbols, sizeof(int32_t));
+        levelOne = s.section(h.levelOne, sizeof(DbLevelOne));
+        levelTwo = s.section(h.levelTwo, sizeof(DbLevelTwo));
+        links = s.section(h.links, sizeof(DbLink));
+        replacements = s.section(h.replacements, sizeof(DbReplacement));
+        atoms = s.section(h.atoms, sizeof(DbCode));
+        bounds = s.section(h.bounds, 3 * sizeof(int32_t));
+        valid = s.exact();
+    }
+};
+
+vector<string> descriptorSources(const string& dir)
+{
+    auto base = fs::path(dir);
+    return { (base / "descr1.csv").string(), (base / "descr2.sdf").string(),
+        (base / "replacement.sdf").string() };
+}
+
+static const uint64_t fnvBasis = 14695981039346656037ULL;
+
+static uint64_t fnv1a(uint64_t hash, const char* data, size_t size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// FNV-1a of file contents, 0 if there is no such file
+static uint64_t hashFile(const string& path)
+{
+    ifstream f(path, ios::binary);
+    if(!f)
+        return 0;
+    uint64_t hash = fnvBasis;
+    char buf[16 << 10];
+    while(f.read(buf, sizeof(buf)) || f.gcount())
+        hash = fnv1a(hash, buf, f.gcount());
+    return hash;
+}
+
+template<class T>
+static void section(ostream& out, const vector<T>& items)
+{
+    uint64_t size = items.size() * sizeof(T);
+    out.write(reinterpret_cast<const char*>(items.data()), size);
+    pad(out, size);
+}
+
+namespace {
+
+// numbers codes by symbol as they are written
+struct SymbolTable{
+    string bytes;
+    vector<int32_t> codes;
+    map<int, int32_t> numbers; // code index -> symbol number
+
+    SymbolTable()
+    {
+        // all of them so that loading registers the same symbols in the same order
+        for(int i = 0; i < Code::atoms(); i++)
+            add(Code(i));
+    }
+
+    int32_t add(Code code)
+    {
+        auto it = numbers.find(code.code());
+        if(it != numbers.end())
+            return it->second;
+        bytes += code.symbol();
+        bytes += '\0';
+        codes.push_back(code.code());
+        return numbers[code.code()] = codes.size() - 1;
+    }
+
+    DbCode operator()(Code code)
+    {
+        return DbCode{ add(code), code.charge() };
+    }
+};
+
+}
+
+void writeDescriptorImage(const DescriptorDB& db, const vector<string>& sources, ostream& out)
+{
+    SymbolTable symbols;
+    vector<DbLevelOne> levelOne;
+    for(auto& e : db.first)
+        levelOne.push_back(DbLevelOne{ symbols(e.center), e.valence, e.dc });
+    vector<DbLevelTwo> levelTwo;
+    vector<DbLink> links;
+    for(auto& e : db.second)
+    {
+        levelTwo.push_back(DbLevelTwo{ symbols(e.center), e.start, e.valence, e.monolith, e.replOnly,
+            e.dc, (uint32_t)links.size(), (uint32_t)e.bonds.size() });
+        for(auto& l : e.bonds)
+            links.push_back(DbLink{ symbols(l.atom), l.bondType });
+    }
+    vector<DbReplacement> repls;
+    vector<DbCode> atoms;
+    vector<int32_t> bounds;
+    for(auto& r : db.replacements)
+    {
+        auto& g = r.piece;
+        repls.push_back(DbReplacement{ (uint32_t)atoms.size(), (uint32_t)num_vertices(g),
+            (uint32_t)bounds.size() / 3, (uint32_t)num_edges(g), r.a1, r.a2, r.dc, r.coupling });
+        for(auto v : boost::make_iterator_range(vertices(g)))
+            atoms.push_back(symbols(g[v].code));
+        // in graph order so that the loaded piece is the same graph
+        for(auto e : boost::make_iterator_range(edges(g)))
+        {
+            bounds.push_back(source(e, g));
+            bounds.push_back(target(e, g));
+            bounds.push_back(g[e].type);
+        }
+    }
+    DbImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, imageMagic, sizeof(imageMagic));
+    header.version = imageVersion;
+    header.symbolBytes = symbols.bytes.size();
+    header.symbols = symbols.codes.size();
+    header.levelOne = levelOne.size();
+    header.levelTwo = levelTwo.size();
+    header.links = links.size();
+    header.replacements = repls.size();
+    header.atoms = atoms.size();
+    header.bounds = bounds.size() / 3;
+    for(size_t i = 0; i < sources.size() && i < 3; i++)
+        header.sources[i] = hashFile(sources[i]);
+    section(out, vector<DbImageHeader>(1, header));
+    section(out, vector<char>(symbols.bytes.begin(), symbols.bytes.end()));
+    section(out, symbols.codes);
+    section(out, levelOne);
+    section(out, levelTwo);
+    section(out, links);
+    section(out, repls);
+    section(out, atoms);
+    out.write(reinterpret_cast<const char*>(bounds.data()), bounds.size() * sizeof(int32_t));
+}
+
+void readDescriptorImage(const string& path, const vector<string>& sources, DescriptorDB& db)
+{
+    auto& first = db.first;
+    auto& second = db.second;
+    auto& replacements = db.replacements;
+    MappedFile file(path);
+    const char* base = file.data();
+    if(file.size() < sizeof(DbImageHeader) || memcmp(base, imageMagic, sizeof(imageMagic)) != 0)
+        error("'" + path + "' is not a descriptor DB image");
+    auto header = reinterpret_cast<const DbImageHeader*>(base);
+    if(header->version != imageVersion)
+        error("'" + path + "' has unsupported version " + to_string(header->version));
+    DbImageLayout layout(*header, file.size());
+    if(!layout.valid)
+        error("'" + path + "' is truncated or corrupted");
+    for(size_t i = 0; i < sources.size() && i < 3; i++)
+    {
+        uint64_t hash = hashFile(sources[i]);
+        if(hash && hash != header->sources[i])
+            error("'" + path + "' is out of date, " + sources[i] + " has changed since it was compiled");
+    }
+    // codes must get the same indices as at compile time, tables are sorted by them
+    vector<Code> codes;
+    auto index = reinterpret_cast<const int32_t*>(base + layout.codes);
+    const char* sym = base + layout.symbols;
+    const char* symEnd = sym + header->symbolBytes;
+    for(uint64_t i = 0; i < header->symbols; i++)
+    {
+        if(sym >= symEnd)
+            error("'" + path + "' is truncated or corrupted");
+        size_t len = strnlen(sym, symEnd - sym);
+        string symbol(sym, len);
+        // known codes are taken by index as a symbol may be listed twice
+        // in the periodic table, new ones are registered in the same order
+        bool known = index[i] < Code::atoms() && Code(index[i]).symbol() == symbol;
+        Code code = known ? Code(index[i]) : Code(symbol);
+        if(code.code() != index[i])
+            error("'" + path + "' doesn't fit symbols known so far, code of "
+                + code.symbol() + " has changed");
+        codes.push_back(code);
+        sym += len + 1;
+    }
+    auto code = [&](const DbCode& c){
+        if(c.symbol < 0 || c.symbol >= (int32_t)codes.size())
+            error("'" + path + "' is corrupted, bad symbol number");
+        Code result = codes[c.symbol];
+        return result.charge(c.charge);
+    };
+    auto levelOne = reinterpret_cast<const DbLevelOne*>(base + layout.levelOne);
+    first.clear();
+    first.reserve(header->levelOne);
+    for(uint64_t i = 0; i < header->levelOne; i++)
+        first.push_back(LevelOne{ code(levelOne[i].center), levelOne[i].valence, levelOne[i].dc });
+    auto levelTwo = reinterpret_cast<const DbLevelTwo*>(base + layout.levelTwo);
+    auto links = reinterpret_cast<const DbLink*>(base + layout.links);
+    second.clear();
+    second.reserve(header->levelTwo);
+    for(uint64_t i = 0; i < header->levelTwo; i++)
+    {
+        auto& e = levelTwo[i];
+        if((uint64_t)e.link + e.links > header->links)
+            error("'" + path + "' is corrupted, bad link range");
+        vector<Linked> bonds;
+        bonds.reserve(e.links);
+        for(auto l = links + e.link; l != links + e.link + e.links; l++)
+            bonds.emplace_back(code(l->atom), l->bondType);
+        second.push_back(LevelTwo{ code(e.center), e.start, e.valence, e.monolith != 0,
+            e.replOnly != 0, std::move(bonds), e.dc });
+    }
+    auto repls = reinterpret_cast<const DbReplacement*>(base + layout.replacements);
+    auto atoms = reinterpret_cast<const DbCode*>(base + layout.atoms);
+    auto bounds = reinterpret_cast<const int32_t*>(base + layout.bounds);
+    replacements.clear();
+    replacements.reserve(header->replacements);
+    for(uint64_t i = 0; i < header->replacements; i++)
+    {
+        auto& r = repls[i];
+        if((uint64_t)r.atom + r.atoms > header->atoms || (uint64_t)r.bound + r.bounds > header->bounds)
+            error("'" + path + "' is corrupted, bad replacement range");
+        ChemGraph piece(r.atoms);
+        for(uint32_t a = 0; a < r.atoms; a++)
+            piece[a] = AtomVertex(code(atoms[r.atom + a]));
+        for(auto b = bounds + r.bound * 3; b != bounds + (r.bound + r.bounds) * 3; b += 3)
+        {
+            if(b[0] < 0 || b[1] < 0 || (uint32_t)b[0] >= r.atoms || (uint32_t)b[1] >= r.atoms)
+                error("'" + path + "' is corrupted, bad bound in replacement");
+            add_edge(b[0], b[1], Bound(b[2]), piece);
+        }
+        replacements.emplace_back(std::move(piece), r.a1, r.a2, r.dc, r.coupling);
+    }
+}
+
+uint64_t descriptorFingerprint(const DescriptorDB& db)
+{
+    ostringstream image;
+    writeDescriptorImage(db, {}, image);
+    auto bytes = image.str();
+    return fnv1a(fnvBasis, bytes.data(), bytes.size());
+}
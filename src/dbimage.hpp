@@ -0,0 +1,79 @@
+// Descriptor DB compiled into a single binary image, see `fcss-2a compile`.
+// Loading the image skips parsing of descr1.csv, descr2.sdf and
+// replacement.sdf as well as sorting of the tables
+#pragma once
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+#include "descriptors.hpp"
+
+// Layout, native byte order, each section starts at a multiple of 8 bytes:
+//   header
+//   symbols      - 0-terminated symbols, all atom codes known at the time of compiling
+//                  in the order of code index followed by wildcards used in the tables
+//   codes        - int32 code index of each symbol at the time of compiling
+//   levelOne     - DbLevelOne records in table order
+//   levelTwo     - DbLevelTwo records in table order
+//   links        - DbLink records, bonds of level two records
+//   replacements - DbReplacement records
+//   atoms        - DbCode per atom of replacement pieces
+//   bounds       - int32 triples: atom, atom (within the piece), bound type
+struct DbImageHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t symbolBytes;
+    uint64_t symbols;
+    uint64_t levelOne;
+    uint64_t levelTwo;
+    uint64_t links;
+    uint64_t replacements;
+    uint64_t atoms;
+    uint64_t bounds;
+    uint64_t sources[3]; // hashes of the text files the image was made of
+};
+
+struct DbCode{
+    int32_t symbol; // number in symbols section
+    int32_t charge;
+};
+
+struct DbLevelOne{
+    DbCode center;
+    int32_t valence, dc;
+};
+
+struct DbLink{
+    DbCode atom;
+    int32_t bondType;
+};
+
+struct DbLevelTwo{
+    DbCode center;
+    int32_t start, valence, monolith, replOnly, dc;
+    uint32_t link, links; // first link and count
+};
+
+struct DbReplacement{
+    uint32_t atom, atoms; // first atom and count
+    uint32_t bound, bounds; // first bound and count
+    int32_t a1, a2, dc, coupling;
+};
+
+// text files of the descriptor DB in 'dir', in the order hashed in the image
+std::vector<std::string> descriptorSources(const std::string& dir);
+
+// name of the image in a descriptor DB directory
+extern const char* const descriptorImageName;
+
+// write DB loaded from 'sources' (see descriptorSources) as an image
+void writeDescriptorImage(const DescriptorDB& db, const std::vector<std::string>& sources, std::ostream& out);
+
+// DB from an image, throws std::logic_error if it's not valid, is made of
+// other text files than 'sources' that are present or if codes can't get
+// the same indices as when it was compiled (then the tables would be out of order)
+void readDescriptorImage(const std::string& path, const std::vector<std::string>& sources, DescriptorDB& db);
+
+// FNV-1a of the image 'db' would be written as without source hashes, the
+// same for DBs with the same tables and symbol codes however they were loaded
+uint64_t descriptorFingerprint(const DescriptorDB& db);
@@ -0,0 +1,199 @@
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <string.h>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include "decompress.hpp"
+
+using namespace std;
+namespace io = boost::iostreams;
+
+enum Compression { PLAIN, GZIP, ZSTD };
+
+static Compression detect(const char* data, size_t size)
+{
+    if(size >= 2 && memcmp(data, "\x1f\x8b", 2) == 0)
+        return GZIP;
+    if(size >= 4 && memcmp(data, "\x28\xb5\x2f\xfd", 4) == 0)
+        return ZSTD;
+    return PLAIN;
+}
+
+bool isCompressed(const char* data, size_t size)
+{
+    return detect(data, size) != PLAIN;
+}
+
+// bytes already read to detect the format followed by the rest of stream
+struct PrefixedSource{
+    typedef char char_type;
+    typedef io::source_tag category;
+    string prefix;
+    size_t used;
+    istream* inp;
+
+    streamsize read(char* s, streamsize n)
+    {
+        streamsize got = 0;
+        if(used < prefix.size())
+        {
+            got = min<streamsize>(n, prefix.size() - used);
+            memcpy(s, prefix.data() + used, got);
+            used += got;
+        }
+        if(got < n)
+        {
+            inp->read(s + got, n - got);
+            got += inp->gcount();
+        }
+        return got ? got : -1;
+    }
+};
+
+// a bounded queue of decompressed blocks filled by the worker thread
+class DecompressStream::Buffer : public std::streambuf{
+public:
+    template<class Source>
+    Buffer(Compression format, Source src):
+        done(false), stop(false)
+    {
+        worker = thread([this, format, src](){ run(format, src); });
+    }
+
+    ~Buffer()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stop = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+protected:
+    int_type underflow() override
+    {
+        if(gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this](){ return !blocks.empty() || done; });
+        if(blocks.empty())
+        {
+            if(error)
+            {
+                // report once, then it's the end of stream
+                auto e = error;
+                error = nullptr;
+                rethrow_exception(e);
+            }
+            return traits_type::eof();
+        }
+        current.swap(blocks.front());
+        blocks.pop_front();
+        changed.notify_all();
+        setg(&current[0], &current[0], &current[0] + current.size());
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    static const size_t blockSize = 1 << 20;
+    static const size_t pieceSize = 1 << 16;
+    static const size_t maxBlocks = 4;
+
+    template<class Source>
+    void run(Compression format, Source src)
+    {
+        string block;
+        size_t size = 0;
+        try{
+            io::filtering_istreambuf in;
+            if(format == GZIP)
+                in.push(io::gzip_decompressor());
+            else if(format == ZSTD)
+                in.push(io::zstd_decompressor());
+            in.push(src);
+            for(bool more = true; more; )
+            {
+                // read in smaller pieces so that data decoded before an error still gets through
+                block.resize(blockSize);
+                size = 0;
+                while(size < blockSize)
+                {
+                    auto n = in.sgetn(&block[size], min(pieceSize, blockSize - size));
+                    if(n <= 0)
+                    {
+                        more = false;
+                        break;
+                    }
+                    size += n;
+                }
+                block.resize(size);
+                if(!push(block))
+                    return;
+                size = 0;
+            }
+        }
+        catch(...){
+            lock_guard<mutex> guard(lock);
+            error = current_exception();
+        }
+        block.resize(size);
+        push(block);
+        lock_guard<mutex> guard(lock);
+        done = true;
+        changed.notify_all();
+    }
+
+    // hand a block to the reader, false if the stream is being destroyed
+    bool push(string& block)
+    {
+        if(block.empty())
+            return true;
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this](){ return blocks.size() < maxBlocks || stop; });
+        if(stop)
+            return false;
+        blocks.push_back(std::move(block));
+        block.clear();
+        changed.notify_all();
+        return true;
+    }
+
+    mutex lock;
+    condition_variable changed;
+    deque<string> blocks;
+    string current; // block being read
+    bool done, stop;
+    exception_ptr error;
+    thread worker;
+};
+
+// min() takes them by reference
+const size_t DecompressStream::Buffer::blockSize;
+const size_t DecompressStream::Buffer::pieceSize;
+
+DecompressStream::DecompressStream(const char* data, size_t size):
+    istream(nullptr),
+    buffer(new Buffer(detect(data, size), io::array_source(data, size)))
+{
+    rdbuf(buffer.get());
+    exceptions(badbit); // pass decompression errors on to the reader
+}
+
+DecompressStream::DecompressStream(istream& raw):
+    istream(nullptr)
+{
+    char magic[4];
+    raw.read(magic, sizeof(magic));
+    string prefix(magic, raw.gcount());
+    buffer.reset(new Buffer(detect(prefix.data(), prefix.size()), PrefixedSource{prefix, 0, &raw}));
+    rdbuf(buffer.get());
+    exceptions(badbit);
+}
+
+DecompressStream::~DecompressStream(){}
@@ -0,0 +1,24 @@
+// Transparent decompression of gzip and zstd inputs
+#pragma once
+#include <istream>
+#include <memory>
+#include <string>
+
+// true if 'data' starts with gzip or zstd magic bytes
+bool isCompressed(const char* data, size_t size);
+
+// Decompressed contents of gzip or zstd input as std::istream.
+// Decompression runs on its own thread a few blocks ahead of the reader,
+// so that it overlaps with parsing and encoding.
+// Errors in compressed data are thrown from the read that hits them
+class DecompressStream : public std::istream{
+public:
+    // compressed data in memory e.g. mapped file, 'data' must outlive the stream
+    DecompressStream(const char* data, size_t size);
+    // format is detected from the first bytes, plain input is passed as is
+    explicit DecompressStream(std::istream& raw);
+    ~DecompressStream();
+private:
+    class Buffer;
+    std::unique_ptr<Buffer> buffer;
+};
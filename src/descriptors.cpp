@@ -35,6 +35,14 @@ Replacement::Replacement(ChemGraph g, int dc_, int coupling_) :
     }
 }
 
+Replacement::Replacement(ChemGraph g, int a1_, int a2_, int dc_, int coupling_) :
+    piece(std::move(g)), a1(a1_), a2(a2_), dc(dc_), coupling(coupling_)
+{
+    int n = num_vertices(piece);
+    if(a1 < 0 || a2 < 0 || a1 >= n || a2 >= n)
+        throw std::logic_error("Bad replacement loaded");
+}
+
 auto read1stOrder(istream& inp) -> vector<LevelOne>
 {
     vector<LevelOne> dest;
@@ -42,9 +50,9 @@ auto read1stOrder(istream& inp) -> vector<LevelOne>
     Parser parser(inp);
     while (!parser.eof())
     {
-        string sym = parser.quotedString();
-        string valency = parser.quotedString();
-        stringstream dcStr(parser.line()); //rest of the line
+        string sym = parser.quotedString().to_string();
+        string valency = parser.quotedString().to_string();
+        stringstream dcStr(parser.line().to_string()); //rest of the line
         int dc;
         dcStr >> dc;
         Code code(sym);
@@ -150,3 +158,125 @@ auto readReplacements(istream& inp) -> vector<Replacement>
     });
     return repls;
 }
+
+// bound types 1-3, the rest share the last slot
+static int boundSlot(int boundType)
+{
+    return boundType >= 1 && boundType <= 3 ? boundType - 1 : 3;
+}
+
+static int elementClass(Code atom)
+{
+    switch (atom.code()){
+    case H_code: return 0;
+    case C_code: return 1;
+    case N_code: return 2;
+    case O_code: return 3;
+    case S_code: return 4;
+    case F_code: case Cl_code: case Br_code: case I_code: return 5;
+    case P_code: return 6;
+    default: return 7;
+    }
+}
+
+void NeighborSignature::count(int boundType)
+{
+    int shift = boundSlot(boundType) * 8;
+    if (((counts >> shift) & 0x7F) < 0x7F) // saturates below the guard bit
+        counts += 1u << shift;
+}
+
+void NeighborSignature::addNeighbor(Code atom, int boundType)
+{
+    int slot = boundSlot(boundType);
+    if (atom.isWild())
+        present |= 0x11111111u << slot;
+    else
+        present |= 1u << (elementClass(atom) * 4 + slot);
+    count(boundType);
+}
+
+void NeighborSignature::addRequired(Code atom, int boundType)
+{
+    if (!atom.isWild())
+        present |= 1u << (elementClass(atom) * 4 + boundSlot(boundType));
+    count(boundType);
+}
+
+LevelTwoIndex::LevelTwoIndex(const vector<LevelTwo>& table):
+    entries(table.size())
+{
+    for (size_t i = 0; i < table.size(); i++)
+    {
+        auto& e = table[i];
+        if (e.valence < 0) // no atom has it
+            continue;
+        if (e.center.isWild())
+        {
+            if (wild.size() <= (size_t)e.valence)
+                wild.resize(e.valence + 1);
+            wild[e.valence].emplace_back(i, e.center);
+            continue;
+        }
+        if (exact.size() <= (size_t)e.center.code())
+            exact.resize(e.center.code() + 1);
+        auto& byValence = exact[e.center.code()];
+        if (byValence.size() <= (size_t)e.valence)
+            byValence.resize(e.valence + 1, Range(0, 0));
+        auto& r = byValence[e.valence];
+        if (r.first == r.second) // sorted by (center, valence), the rest follows
+            r = Range(i, i);
+        r.second = i + 1;
+    }
+}
+
+void LevelTwoIndex::candidates(Code atom, int valence, vector<size_t>& out)const
+{
+    out.clear();
+    if (valence < 0)
+        return;
+    // wildcard centers come first in the table
+    if ((size_t)valence < wild.size())
+        for (auto& w : wild[valence])
+            if (w.second.matches(atom))
+                out.push_back(w.first);
+    auto add = [&](int code){
+        auto& byValence = exact[code];
+        if ((size_t)valence < byValence.size())
+            for (auto i = byValence[valence].first; i != byValence[valence].second; i++)
+                out.push_back(i);
+    };
+    if (!atom.isWild())
+    {
+        if ((size_t)atom.code() < exact.size())
+            add(atom.code());
+    }
+    else // wildcard in the molecule itself, in code order as in the table
+    {
+        for (size_t c = 0; c < exact.size(); c++)
+            if (Code((int)c).matches(atom))
+                add(c);
+    }
+}
+
+void DescriptorDB::prepare()
+{
+    secondByCenter = LevelTwoIndex(second);
+    secondSignatures.clear();
+    for (auto& e : second)
+    {
+        NeighborSignature sig;
+        for (auto& l : e.bonds)
+            sig.addRequired(l.atom, l.bondType);
+        secondSignatures.push_back(sig);
+    }
+    replacementPlans.clear();
+    for (auto& r : replacements)
+        replacementPlans.emplace_back(r);
+    size_t symmetries = 0;
+    for(auto& plan : replacementPlans)
+        symmetries += plan.symmetries.size();
+    LOG(DEBUG) << "Replacements have " << symmetries << " symmetries to skip" << endline;
+    replacementTrie = ReplacementTrie(replacements, replacementPlans);
+    LOG(DEBUG) << "Replacements compiled into " << replacementTrie.steps() << " matching steps" << endline;
+}
@@ -2,9 +2,11 @@
 
 #include <vector>
 #include <istream>
+#include <stdint.h>
 #include <unordered_map>
 #include "periodic.hpp"
 #include "chemgraph.hpp"
+#include "anchored.hpp"
 
 struct LevelOne{
     Code center;
@@ -45,9 +47,68 @@ struct Replacement{
     int dc, coupling;
 
     Replacement(ChemGraph g, int dc_, int coupling_);
+    // piece that has A1 and A2 at a1 and a2 already turned into R
+    Replacement(ChemGraph g, int a1_, int a2_, int dc_, int coupling_);
 };
 
 
+// Element classes and bound types around an atom, or the ones a second-order
+// pattern needs around its center. A pattern can only match an atom whose
+// signature covers it, this is checked without building the bound matrix
+struct NeighborSignature{
+    uint32_t present; // bit per element class and bound type
+    uint32_t counts;  // number of bounds of each type, a byte per type
+
+    NeighborSignature():present(0), counts(0){}
+    // neighbor of an atom, a wildcard one may be of any class
+    void addNeighbor(Code atom, int boundType);
+    // bound of a pattern, a wildcard only needs a bound of that type
+    void addRequired(Code atom, int boundType);
+    bool covers(const NeighborSignature& pattern)const
+    {
+        // no byte of counts may borrow from the guard bit
+        const uint32_t guard = 0x80808080;
+        return (pattern.present & ~present) == 0
+            && (((counts | guard) - pattern.counts) & guard) == guard;
+    }
+private:
+    void count(int boundType);
+};
+
+// Second-order patterns that may match an atom by its code and valence,
+// for a table sorted by (center, valence). Patterns with a concrete center
+// are a contiguous range per code and valence, wildcard centers (sorted
+// before any atom) are listed per valence. Candidates come in table order
+class LevelTwoIndex{
+public:
+    LevelTwoIndex():entries(0){}
+    explicit LevelTwoIndex(const std::vector<LevelTwo>& table);
+    // numbers of patterns in the table centered on 'atom' with 'valence'
+    void candidates(Code atom, int valence, std::vector<size_t>& out)const;
+    // size of the table it was built for
+    size_t size()const{ return entries; }
+private:
+    typedef std::pair<uint32_t, uint32_t> Range;  // [first, last) in the table
+    std::vector<std::vector<Range>> exact;        // [code][valence]
+    std::vector<std::vector<std::pair<uint32_t, Code>>> wild; // [valence] -> entry, center
+    size_t entries;
+};
+
+// The whole DB, loaded once and shared read-only by all encoders
+// (see FCSPOptions) so that threads don't keep copies of it
+struct DescriptorDB{
+    std::vector<LevelOne> first;
+    std::vector<LevelTwo> second;
+    std::vector<Replacement> replacements;
+    LevelTwoIndex secondByCenter;
+    std::vector<NeighborSignature> secondSignatures; // of each entry in 'second'
+    std::vector<PiecePlan> replacementPlans; // of each entry in 'replacements'
+    ReplacementTrie replacementTrie;
+
+    // build lookup structures, once tables are loaded
+    void prepare();
+};
+
 //read
 std::vector<LevelOne> read1stOrder(std::istream& inp);
 std::vector<LevelTwo> read2ndOrder(std::istream& inp);
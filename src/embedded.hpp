@@ -0,0 +1,14 @@
+// Files compiled into the executable, see `scons --embed-db`
+#pragma once
+#include <cstddef>
+
+struct EmbeddedFile{
+    const char* name;
+    const char* data;
+    size_t size;
+};
+
+#ifdef EMBED_DB
+// descr1.csv, descr2.sdf and replacement.sdf in this order
+extern const EmbeddedFile embeddedDescriptors[3];
+#endif
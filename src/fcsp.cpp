@@ -8,16 +8,22 @@
 #include <numeric>
 #include <iomanip>
 #include <set>
+#include <chrono>
 #include <boost/graph/vf2_sub_graph_iso.hpp>
 #include <boost/graph/depth_first_search.hpp>
 #include <boost/graph/breadth_first_search.hpp>
 #include <boost/graph/visitors.hpp>
 
+#include "anchored.hpp"
+#include "bondmatch.hpp"
 #include "conv.hpp"
 #include "ctab.hpp"
 #include "descriptors.hpp"
 #include "fcsp.hpp"
+#include "generated.hpp"
 #include "log.hpp"
+#include "smiles.hpp"
+#include "corpus.hpp"
 
 enum { NON_PASSABLE = 10000 };
 using namespace std;
@@ -41,36 +47,6 @@ bool is_exclusive_dc(int dc)
     return dc == 45 || dc == 46; // these are impassable if one is part of chain
 }
 
-// Select 1-s from bool matrix so that 
-// there is at least one selected per row
-// and no more then one per column
-// Input:
-// matrix - bool matrix
-// selections : row idx --> col idx
-// cur - number of currently matching row
-bool pickChoices(const vector<bool>& matrix, size_t rows, size_t cols, vector<size_t>& selections, size_t cur=0)
-{
-    if(cur == rows)
-        return true;
-    for(size_t i=0; i<cols; i++)
-    {
-        if(matrix[cur*cols + i])
-        {
-            selections[cur] = i;
-            auto end = selections.begin()+cur;
-            // not chosen before
-            if(find(selections.begin(), selections.begin()+cur, i) == end)
-            {
-                if(pickChoices(matrix, rows, cols, selections, cur+1))
-                    return true;
-                else
-                    selections[cur] = -1; // reset and continue
-            }
-        }
-    }
-    return false;
-}
-
 struct TrackPath: public default_bfs_visitor {
     ChemGraph& g;
     vector<pair<vd, int>>& dcs;
@@ -137,23 +113,24 @@ struct TrackPath: public default_bfs_visitor {
 
 // callback for VF2 algorithm
 struct CollectAsVectors{
-    ChemGraph& pattern;
-    vector<vector<size_t>>& mappings; // mapped atoms in the bigger graph
+    const ChemGraph& pattern;
+    const PiecePlan& plan; // symmetric copies of a mapping are dropped
+    Mappings& mappings; // mapped atoms in the bigger graph
 
     
-    CollectAsVectors(ChemGraph& pat, vector<vector<size_t>>& _mappings):pattern(pat), mappings(_mappings){}
+    CollectAsVectors(const ChemGraph& pat, const PiecePlan& _plan, Mappings& _mappings):
+        pattern(pat), plan(_plan), mappings(_mappings){}
     template <typename CorrespondenceMap1To2,
           typename CorrespondenceMap2To1>
     bool operator()(CorrespondenceMap1To2 f, CorrespondenceMap2To1 g) const
     {
-        auto vtx = vertices(pattern);
-        vector<size_t> in_big;
-        for(auto p=vtx.first; p != vtx.second; p++)
+        auto& in_big = mappings.add(num_vertices(pattern));
+        for(auto v : make_iterator_range(vertices(pattern)))
         {
-            in_big.push_back(get(f, *p));
+            in_big[v] = get(f, v);
         }
-        using std::move;
-        mappings.push_back(move(in_big));
+        if(!plan.canonical(in_big))
+            mappings.pop();
         return true;
     }
 };
@@ -184,18 +161,81 @@ pair<int,int> multiCount(ChemGraph& graph, ChemGraph::vertex_descriptor vertex)
     return make_pair(dual, tripple);
 }
 
+// logs time spent in each stage of encoding, see -v 5
+struct StageTimer{
+    typedef chrono::steady_clock clock;
+    clock::time_point last = clock::now();
+    void operator()(const char* stage)
+    {
+        auto now = clock::now();
+        LOG(DEBUG) << "Stage " << stage << ": "
+            << chrono::duration<double, milli>(now - last).count() << " ms" << endline;
+        last = now;
+    }
+};
+
 struct FCSP::Impl{
     Impl(FCSPOptions opts) :
-        order1(std::move(opts.first)), order2(std::move(opts.second)), 
-        repls(std::move(opts.replacements)),
-        long41(opts.long41), format(opts.format){}
+        db(std::move(opts.db)), order1(db->first), order2(db->second),
+        repls(db->replacements),
+        long41(opts.long41), format(opts.format), matcher(opts.matcher), generated(opts.generated)
+    {
+        if(db->secondByCenter.size() != order2.size() || db->secondSignatures.size() != order2.size()
+                || db->replacementTrie.size() != repls.size())
+            throw logic_error("descriptor DB is not prepared for lookups");
+        if(generated && (generated->second != order2.size() || generated->replacements != repls.size()))
+            throw logic_error("generated matchers are made of another descriptor DB");
+    }
 
     void load(istream& inp)
     {
-        CTab tab = readMol(inp);
+        GraphSink sink(graph);
+        readMol(inp, sink, TOPOLOGY);
+        checkAtoms();
+    }
+
+    void load(const char* data, size_t size)
+    {
+        GraphSink sink(graph);
+        readMol(data, size, sink, TOPOLOGY);
+        checkAtoms();
+    }
+
+    bool load(SdfReader& reader, SdfProps& props)
+    {
+        GraphSink sink(graph);
+        if(!reader.next(sink, props))
+            return false;
+        checkAtoms();
+        return true;
+    }
+
+    void load(CTab& tab)
+    {
         graph = toGraph(tab);
+        checkAtoms();
         auto comp = connectedComponents(graph);
     }
+
+    void loadSmiles(const char* data, size_t size)
+    {
+        graph = readSmiles(boost::string_ref(data, size));
+    }
+
+    void load(const Corpus& corpus, size_t i)
+    {
+        graph = corpus.graph(i);
+        checkAtoms();
+    }
+
+    // a record with no structure is an error like a malformed one, there
+    // is nothing to encode and cycle search needs an atom to start from
+    void checkAtoms()
+    {
+        if(num_vertices(graph) == 0)
+            throw logic_error("no atoms");
+    }
+
     // Очистить все переменные состояния кодировщика
     void clear()
     {
@@ -230,18 +270,25 @@ struct FCSP::Impl{
 
     void process(ostream& out, string filename)
     {
+        StageTimer lap;
         clear(); // clear state
         addHydrogen(graph);
         locatePiElectrons();
+        lap("prepare");
         locateCycles(); //adds cyclic DCs
+        lap("cycles");
         locateDCs(false);
         locateIrregular();
         sortDCs();
+        lap("dcs");
         cyclic(out);
+        lap("cyclic");
         linear(out);
+        lap("linear");
         locateDCs(true); // REPL-only DCs - 44 so far
         sortDCs();
         replacement(out);
+        lap("replacement");
         outputWhole(out, filename);
     }
 
@@ -376,58 +423,66 @@ struct FCSP::Impl{
                     }
                 }
             }
-            // select a range of DCs pattern with center matching this atom
-            auto range2 = make_pair(order2.begin(), order2.end());
-            for (auto j = range2.first; j != range2.second; j++)
+            // only DC patterns with center matching this atom and its valence
+            db->secondByCenter.candidates(graph[*i].code, valency, candidates);
+            NeighborSignature around;
+            for (auto p = edges.first; p != edges.second; p++)
+                around.addNeighbor(graph[target(*p, graph)].code, graph[*p].type);
+            for (auto k : candidates)
             {
+                auto j = order2.begin() + k;
                 if(j->replOnly != replOnly) // can't use during this stage
                     continue;
                 if (edges.second - edges.first < (int)j->bonds.size())
                     continue;
-                if (!j->center.matches(graph[*i].code))
-                    continue;
-                if (j->valence != valency)
+                if (!around.covers(db->secondSignatures[k])) // some bound can't be matched
                     continue;
                 LOG(TRACE) << "Candidate DC "<< j->dc <<" CENTER " << j->center.symbol() << " VALENCE "<< valency << endline;
 
                 vector<int> atoms; // atoms in this center
                 size_t cand_bnds = edges.second - edges.first;
                 size_t smpl_bnds = j->bonds.size();
-                // Put ones for combinations that match. A row per edge in a DC pattern (sample).
-                // Then we need to pick one in each row, if at least one row is all zeros - no match
-                // Same DC may happen twice in the same atom, but we don't accomodate for that (for now)
-                vector<bool> mappings(cand_bnds*smpl_bnds); 
-                LOG(TRACE) << "MAPPING:" <<endline;
-                LOG(TRACE) << "  ";
-                for(size_t k=0; k<cand_bnds; k++)
-                {
-                    auto e = (edges.first+k);
-                    auto t = target(*e, graph);
-                    LOG(TRACE) << setw(2) << graph[t].code.symbol();
-                }
-                for(size_t p=0; p<smpl_bnds; p++)
+                if(cand_bnds > BondMatcher::maxBounds)
+                    throw logic_error("atom " + to_string(*i + 1) + " has more than "
+                        + to_string(BondMatcher::maxBounds) + " bounds");
+                // Allow combinations that match. A row per edge in a DC pattern (sample).
+                // Then we need to pick one in each row, if at least one row is empty - no match
+                // Same DC can't happen twice in the same atom, pattern takes all of its valence
+                if(generated)
+                    generated->bounds[k](graph, *i, bondMatcher);
+                else
                 {
-                    LOG(TRACE) << endline << setw(2) << j->bonds[p].atom.symbol();
-                    for(size_t q=0; q<cand_bnds; q++)
+                    bondMatcher.reset(smpl_bnds);
+                    LOG(TRACE) << "MAPPING:" <<endline;
+                    LOG(TRACE) << "  ";
+                    for(size_t k=0; k<cand_bnds; k++)
+                    {
+                        auto e = (edges.first+k);
+                        auto t = target(*e, graph);
+                        LOG(TRACE) << setw(2) << graph[t].code.symbol();
+                    }
+                    for(size_t p=0; p<smpl_bnds; p++)
                     {
-                        auto e = edges.first + q;
-                        if(graph[*e].type == j->bonds[p].bondType)
+                        LOG(TRACE) << endline << setw(2) << j->bonds[p].atom.symbol();
+                        for(size_t q=0; q<cand_bnds; q++)
                         {
-                            auto t = target(*e, graph);
-                            if(j->bonds[p].atom.matches(graph[t].code))
-                                mappings[p*cand_bnds + q] = true;
+                            auto e = edges.first + q;
+                            bool match = graph[*e].type == j->bonds[p].bondType
+                                && j->bonds[p].atom.matches(graph[target(*e, graph)].code);
+                            if(match)
+                                bondMatcher.allow(p, q);
+                            LOG(TRACE) << setw(2) << match;
                         }
-                        LOG(TRACE) << setw(2) << mappings[p*cand_bnds + q];
                     }
+                    LOG(TRACE) << endline;
                 }
-                LOG(TRACE) << endline;
-                vector<size_t> found_mapping(smpl_bnds); // sample idx --> candidate idx
-                if(pickChoices(mappings, smpl_bnds, cand_bnds, found_mapping))
+                size_t found_mapping[BondMatcher::maxBounds]; // sample idx --> candidate idx
+                if(bondMatcher.first(found_mapping))
                 {
-                    for(auto idx : found_mapping)
+                    for(size_t p=0; p<smpl_bnds; p++)
                     {
                         // get atom by index of edge around this atom
-                        auto t = target(*(edges.first + idx), graph);
+                        auto t = target(*(edges.first + found_mapping[p]), graph);
                         atoms.push_back(t);
                     }
                     dcs.emplace_back(*i, j->dc);
@@ -1080,29 +1135,49 @@ struct FCSP::Impl{
     void replacement(ostream& out)
     {
         //cout << "REPLACEMENTS!" << endline;
-        for (auto& r : repls)
+        anchor.assign(num_vertices(graph), false);
+        for(auto& dcp : dcs)
+            if(!graph[dcp.first].inAromaCycle) // none of replacemnt dc are in aroma cycle (e.g. DC 41 is CH3)
+                anchor[dcp.first] = true;
+        auto& trie = db->replacementTrie;
+        auto& plans = db->replacementPlans;
+        // pieces that need more of some atoms or bounds than there are are not looked for
+        counts.count(graph, anchor);
+        wanted.resize(repls.size());
+        for (size_t i = 0; i < repls.size(); i++)
+            wanted[i] = counts.has(plans[i].needs);
+        found.resize(repls.size());
+        if(generated)
+            generated->pieces(graph, anchor, plans, wanted, found);
+        else if(matcher == ReplacementMatcher::TRIE)
+            trie.find(graph, anchor, plans, wanted, live, work, found);
+        for (size_t i = 0; i < repls.size(); i++)
         {
-            vector<vector<size_t>> mappings;
+            auto& r = repls[i];
+            auto& plan = plans[i];
+            auto& mappings = found[i];
             auto& g = graph;
             
-            vf2_subgraph_iso(r.piece, g, CollectAsVectors(g, mappings), vertex_order_by_mult(r.piece),
-                vertices_equivalent([&](ChemGraph::vertex_descriptor a, ChemGraph::vertex_descriptor b){                
-                    if(!r.piece[a].code.matches(g[b].code))
-                        return false;
-                    if(a == r.a1 || a == r.a2){
-                        if(g[b].inAromaCycle) // none of replacemnt dc are in aroma cycle (e.g. DC 41 is CH3)
+            if(!wanted[i])
+                continue;
+            // pieces that are not connected are left to VF2
+            bool matched = (generated || matcher == ReplacementMatcher::TRIE) && trie.compiled(i);
+            if(!matched && matcher == ReplacementMatcher::ANCHORED)
+                matched = anchoredMatches(r, plan, g, anchor, work, mappings);
+            if(!matched)
+            {
+                mappings.clear();
+                vf2_subgraph_iso(r.piece, g, CollectAsVectors(r.piece, plan, mappings), plan.vf2Order,
+                    vertices_equivalent([&](ChemGraph::vertex_descriptor a, ChemGraph::vertex_descriptor b){                
+                        if(!plan.labels[a].matches(g[b].code))
                             return false;
-                        return find_if(dcs.begin(), dcs.end(), [&](pair<vd,size_t> dcp){
-                            return dcp.first == b;
-                        }) != dcs.end();
-                    }
-                    else
-                        return true;
-                }).edges_equivalent(
-                [&r, &g](ChemGraph::edge_descriptor a, ChemGraph::edge_descriptor b){
-                    return r.piece[a].type == g[b].type;
-                })
-            );
+                        return !plan.anchors[a] || anchor[b];
+                    }).edges_equivalent(
+                    [&r, &g](ChemGraph::edge_descriptor a, ChemGraph::edge_descriptor b){
+                        return r.piece[a].type == g[b].type;
+                    })
+                );
+            }
             vector<pair<pair<int, int>, pair<int, int>>> used_pairs;
             for (auto& m : mappings)
             {
@@ -1151,11 +1226,23 @@ struct FCSP::Impl{
     }
 
 private:
-    std::vector<LevelOne> order1;        // patterns for first-order DCs
-    std::vector<LevelTwo> order2;        // patterns for second-order DCs
-    std::vector<Replacement> repls; // patterns for replacement decsriptors (not DCs)
+    std::shared_ptr<const DescriptorDB> db; // shared by all encoders
+    const std::vector<LevelOne>& order1;        // patterns for first-order DCs
+    const std::vector<LevelTwo>& order2;        // patterns for second-order DCs
+    const std::vector<Replacement>& repls; // patterns for replacement decsriptors (not DCs)
+    vector<size_t> candidates; // scratch for second-order patterns of an atom
+    BondMatcher bondMatcher;   // bounds of a second-order pattern to bounds of an atom
+    // scratch of the replacement stage
+    vector<bool> anchor;       // atoms A1 and A2 of replacements may be matched to
+    vector<vd> work;           // mapping being built
+    vector<Mappings> found;    // mappings of each piece
+    MoleculeCounts counts;     // atoms and bounds of the molecule pieces need
+    vector<bool> wanted;       // pieces the molecule has enough of those for
+    vector<bool> live;         // trie steps that lead to wanted pieces
     bool long41;                                        // if true - DC #41 adds +1 to the length of chain
     FCSPFMT format;                                     // controls output format
+    ReplacementMatcher matcher;                         // how replacement pieces are found
+    const GeneratedMatchers* generated;                 // patterns compiled into code, null to interpret the DB
     ChemGraph graph;                                // mol graph
     //location of DCs in 'graph' and their numeric value
     vector<pair<vd, int>> dcs;            // sorted by vertex array of vertex->dc mappings
@@ -1181,6 +1268,31 @@ void FCSP::load(std::istream& inp)
     pimpl->load(inp);
 }
 
+void FCSP::load(const char* data, size_t size)
+{
+    pimpl->load(data, size);
+}
+
+void FCSP::load(CTab& tab)
+{
+    pimpl->load(tab);
+}
+
+bool FCSP::load(SdfReader& reader, SdfProps& props)
+{
+    return pimpl->load(reader, props);
+}
+
+void FCSP::loadSmiles(const char* data, size_t size)
+{
+    pimpl->loadSmiles(data, size);
+}
+
+void FCSP::load(const Corpus& corpus, size_t i)
+{
+    pimpl->load(corpus, i);
+}
+
 
 void FCSP::dumpGraph(std::ostream& dot)
 {
@@ -21,17 +21,36 @@ enum FCSPFMT {
     TXT // TXT - line per file, whitespace separated codes
 };
 
+// how pieces of replacement descriptors are found in a molecule
+enum class ReplacementMatcher {
+    TRIE,     // all pieces at once, grown from DC atoms that A1 and A2 may take
+    ANCHORED, // the same one piece at a time
+    VF2       // vf2_subgraph_iso over the whole molecule
+};
+
+class Corpus;
+struct GeneratedMatchers;
+
+// cheap to copy, all encoders made of it share the same DB
 struct FCSPOptions{
-    std::vector<LevelOne> first;
-    std::vector<LevelTwo> second;
-    std::vector<Replacement> replacements;
+    std::shared_ptr<const DescriptorDB> db;
     bool long41;
     FCSPFMT format;
+    ReplacementMatcher matcher; // for pieces that have no generated matchers
+    const GeneratedMatchers* generated; // made of 'db' at build time, null to interpret it
 };
 
 struct FCSP {
     FCSP(FCSPOptions opts);
     void load(std::istream& inp);
+    void load(const char* data, size_t size);
+    void load(CTab& tab);
+    // next record of 'reader' and its properties, false if there are no more
+    bool load(SdfReader& reader, SdfProps& props);
+    // a single SMILES string, not necessarily 0-terminated
+    void loadSmiles(const char* data, size_t size);
+    // i-th molecule of a packed corpus, no parsing involved
+    void load(const Corpus& corpus, size_t i);
     void dumpGraph(std::ostream& dot);
     void process(std::ostream& out, std::string filename="");
     ~FCSP();
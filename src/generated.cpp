@@ -0,0 +1,231 @@
+#include <map>
+#include "generated.hpp"
+#include "descriptors.hpp"
+#include "dbimage.hpp"
+#include "log.hpp"
+
+using namespace std;
+using namespace boost;
+
+static const GeneratedMatchers* compiledIn = nullptr;
+
+RegisterMatchers::RegisterMatchers(const GeneratedMatchers& matchers)
+{
+    compiledIn = &matchers;
+}
+
+const GeneratedMatchers* generatedMatchers(const DescriptorDB& db)
+{
+    if(!compiledIn)
+        return nullptr;
+    if(compiledIn->fingerprint != descriptorFingerprint(db) || compiledIn->second != db.second.size()
+        || compiledIn->replacements != db.replacements.size())
+    {
+        LOG(WARN) << "Matchers built in are made of another descriptor DB, it is interpreted instead" << endline;
+        return nullptr;
+    }
+    return compiledIn;
+}
+
+namespace {
+
+// condition that 'label' matches code 'atom' in generated source
+string test(Code label, const string& atom)
+{
+    if(label.isWild())
+        return "Code(" + to_string(label.code()) + ").matches(" + atom + ")";
+    return "is(" + to_string(label.code()) + ", " + atom + ")";
+}
+
+const char* const helpers = R"(// the same as Code(label).matches(atom) for a label that is not a wildcard
+static inline bool is(int label, Code atom)
+{
+    return atom.code() == label || (atom.code() < 0 && Code(label).matches(atom));
+}
+
+static inline bool bounded(const ChemGraph& g, vd a, vd b)
+{
+    return edge(a, b, g).second;
+}
+
+static inline bool bound(const ChemGraph& g, vd a, vd b, int type)
+{
+    auto e = edge(a, b, g);
+    return e.second && g[e.first].type == type;
+}
+
+)";
+
+// rows go by bound type and then by atom, rows with both the same share a test
+void writeBounds(ostream& out, size_t k, const LevelTwo& e)
+{
+    out << "// DC " << e.dc << ", " << e.center.symbol() << " of valence " << e.valence << " with";
+    for(auto& l : e.bonds)
+        out << " " << l.atom.symbol() << ":" << l.bondType;
+    out << "\nstatic void second" << k << "(const ChemGraph& g, vd center, BondMatcher& m)\n{\n";
+    out << "    m.reset(" << e.bonds.size() << ");\n";
+    if(e.bonds.empty())
+    {
+        out << "}\n\n";
+        return;
+    }
+    map<int, map<int, vector<size_t>>> rows; // bound type -> atom code -> rows
+    for(size_t p = 0; p < e.bonds.size(); p++)
+        rows[e.bonds[p].bondType][e.bonds[p].atom.code()].push_back(p);
+    out << "    size_t q = 0;\n";
+    out << "    for(auto e : make_iterator_range(out_edges(center, g)))\n    {\n";
+    out << "        Code a = g[target(e, g)].code;\n";
+    out << "        switch(g[e].type){\n";
+    for(auto& type : rows)
+    {
+        out << "        case " << type.first << ":\n";
+        for(auto& atom : type.second)
+        {
+            out << "            if(" << test(Code(atom.first), "a") << ")\n";
+            if(atom.second.size() == 1)
+                out << "                m.allow(" << atom.second[0] << ", q);\n";
+            else
+            {
+                out << "            {\n";
+                for(auto p : atom.second)
+                    out << "                m.allow(" << p << ", q);\n";
+                out << "            }\n";
+            }
+        }
+        out << "            break;\n";
+    }
+    out << "        }\n        q++;\n    }\n}\n\n";
+}
+
+// '|| ' between conditions that go on lines of their own
+void writeAny(ostream& out, const vector<string>& conditions, const string& indent)
+{
+    out << conditions[0];
+    for(size_t c = 1; c < conditions.size(); c++)
+        out << "\n" << indent << "    || " << conditions[c];
+}
+
+}
+
+// ReplacementTrie as nested loops, each node a loop in the one of its parent
+// that checks the same as ReplacementTrie::Search and completes pieces that
+// end there, so pieces that start the same way still share loops
+struct TrieSource{
+    const ReplacementTrie& trie;
+    ostream& out;
+
+    // conditions that atom 'b' can't be taken as step 'k' of 's'
+    vector<string> fails(const ReplacementTrie::Step& s, size_t k, const string& b)const
+    {
+        vector<string> f;
+        if(s.anchor)
+            f.push_back("!anchor[" + b + "]");
+        f.push_back("!" + test(s.code, "g[" + b + "].code"));
+        for(size_t t = 0; t < k; t++)
+            f.push_back(b + " == m[" + to_string(t) + "]");
+        // bounds to earlier steps are just those of the step (induced subgraph)
+        auto bound = s.bounds.begin();
+        for(size_t t = 0; t < k; t++)
+        {
+            string w = "m[" + to_string(t) + "]";
+            if(bound != s.bounds.end() && bound->first == (int)t)
+                f.push_back("!bound(g, " + b + ", " + w + ", " + to_string((bound++)->second) + ")");
+            else
+                f.push_back("bounded(g, " + b + ", " + w + ")");
+        }
+        return f;
+    }
+
+    // 'n' is matched as step k
+    void node(uint32_t n, size_t k, const string& indent)const
+    {
+        auto& here = trie.nodes[n];
+        for(auto piece : here.ends)
+        {
+            auto& vertices = trie.stepVertices[piece];
+            string in = indent + "    ";
+            out << indent << "if(wanted[" << piece << "])\n" << indent << "{\n";
+            out << in << "auto& found = mappings[" << piece << "].add(" << vertices.size() << ");\n";
+            for(size_t t = 0; t < vertices.size(); t++)
+                out << in << "found[" << vertices[t] << "] = m[" << t << "];\n";
+            out << in << "if(!plans[" << piece << "].canonical(found))\n";
+            out << in << "    mappings[" << piece << "].pop();\n";
+            out << indent << "}\n";
+        }
+        for(auto c : here.children)
+        {
+            auto& s = trie.nodes[c].step;
+            string b = "b" + to_string(k + 1);
+            string in = indent + "        ";
+            out << indent << "if(live[" << c << "])\n";
+            out << indent << "    for(auto " << b << " : make_iterator_range(adjacent_vertices(m["
+                << s.parent << "], g)))\n";
+            out << indent << "    {\n";
+            out << in << "if(";
+            writeAny(out, fails(s, k + 1, b), in);
+            out << ")\n" << in << "    continue;\n";
+            out << in << "m[" << k + 1 << "] = " << b << ";\n";
+            node(c, k + 1, in);
+            out << indent << "    }\n";
+        }
+    }
+
+    void write()const
+    {
+        auto& nodes = trie.nodes;
+        out << "// " << trie.pieces << " replacement pieces in " << nodes.size() << " steps\n";
+        out << "static void pieces(const ChemGraph& g, const vector<bool>& anchor, const vector<PiecePlan>& plans,\n"
+            << "    const vector<bool>& wanted, vector<Mappings>& mappings)\n{\n";
+        out << "    mappings.resize(" << trie.pieces << ");\n";
+        out << "    for(auto& m : mappings)\n        m.clear();\n";
+        out << "    // steps that lead to wanted pieces, children come after their parents\n";
+        out << "    bool live[" << max<size_t>(nodes.size(), 1) << "];\n";
+        for(size_t n = nodes.size(); n-- > 0; )
+        {
+            vector<string> leads;
+            for(auto piece : nodes[n].ends)
+                leads.push_back("wanted[" + to_string(piece) + "]");
+            for(auto c : nodes[n].children)
+                leads.push_back("live[" + to_string(c) + "]");
+            out << "    live[" << n << "] = ";
+            writeAny(out, leads, "       ");
+            out << ";\n";
+        }
+        out << "    vd m[" << max<size_t>(trie.depth, 1) << "]; // atom of each step\n";
+        out << "    for(vd b0 = 0; b0 < num_vertices(g); b0++)\n    {\n";
+        out << "        if(!anchor[b0])\n            continue;\n";
+        out << "        m[0] = b0;\n";
+        for(auto r : trie.roots)
+        {
+            out << "        if(live[" << r << "] && !(";
+            writeAny(out, fails(nodes[r].step, 0, "b0"), "            ");
+            out << "))\n        {\n";
+            node(r, 0, "            ");
+            out << "        }\n";
+        }
+        out << "    }\n";
+        for(size_t i = 0; i < trie.pieces; i++)
+            if(trie.compiled(i))
+                out << "    mappings[" << i << "].sortAsVf2(plans[" << i << "]);\n";
+        out << "}\n\n";
+    }
+};
+
+void writeGeneratedMatchers(const DescriptorDB& db, ostream& out)
+{
+    out << "// generated by `fcss-2a generate` from the descriptor DB, do not edit\n";
+    out << "#include \"generated.hpp\"\n\n";
+    out << "using namespace std;\nusing namespace boost;\n\n";
+    out << helpers;
+    for(size_t k = 0; k < db.second.size(); k++)
+        writeBounds(out, k, db.second[k]);
+    TrieSource{ db.replacementTrie, out }.write();
+    // a null at the end so that it is not empty
+    out << "static const BoundsMatcher bounds[] = {\n";
+    for(size_t k = 0; k < db.second.size(); k++)
+        out << "    second" << k << ",\n";
+    out << "    nullptr\n};\n\n";
+    out << "static const GeneratedMatchers matchers = { 0x" << hex << descriptorFingerprint(db) << dec << "ULL, "
+        << db.second.size() << ", " << db.replacements.size() << ", bounds, pieces };\n\n";
+    out << "static RegisterMatchers registered(matchers);\n";
+}
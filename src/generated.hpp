@@ -0,0 +1,38 @@
+// Matchers generated from a descriptor DB at build time (`scons --gen-matchers`),
+// second-order patterns and replacement pieces are code with their atoms and
+// bound types as constants instead of being read from tables
+#pragma once
+#include <ostream>
+#include <vector>
+#include <stdint.h>
+#include "chemgraph.hpp"
+#include "bondmatch.hpp"
+#include "anchored.hpp"
+
+struct DescriptorDB;
+
+// rows of 'matcher' for bounds of a second-order pattern, allowed for
+// bounds of 'center' they may go to the same way locateDCs allows them
+typedef void (*BoundsMatcher)(const ChemGraph& g, vd center, BondMatcher& matcher);
+// mappings of all replacement pieces that ReplacementTrie::find finds, the
+// trie is unrolled into loops that end in code of each piece
+typedef void (*PiecesMatcher)(const ChemGraph& g, const std::vector<bool>& anchor,
+    const std::vector<PiecePlan>& plans, const std::vector<bool>& wanted, std::vector<Mappings>& mappings);
+
+struct GeneratedMatchers{
+    uint64_t fingerprint; // of the DB they were made of, see descriptorFingerprint
+    size_t second, replacements;
+    const BoundsMatcher* bounds; // of each entry in DescriptorDB::second
+    PiecesMatcher pieces;
+};
+
+// generated source registers its matchers by making one of these
+struct RegisterMatchers{
+    explicit RegisterMatchers(const GeneratedMatchers& matchers);
+};
+
+// matchers compiled in, null if there are none or they were made of another DB than 'db'
+const GeneratedMatchers* generatedMatchers(const DescriptorDB& db);
+
+// C++ source of matchers for 'db', see `fcss-2a generate`
+void writeGeneratedMatchers(const DescriptorDB& db, std::ostream& out);
@@ -0,0 +1,191 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <ctype.h>
+#include <boost/filesystem.hpp>
+#include "inputs.hpp"
+#include "log.hpp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+bool globMatch(const string& pattern, const string& name)
+{
+    size_t p = 0, n = 0;
+    size_t star = string::npos, resume = 0; // last '*' and where it's retried from
+    while(n < name.size())
+    {
+        if(p < pattern.size() && (pattern[p] == '?' ||
+            tolower((unsigned char)pattern[p]) == tolower((unsigned char)name[n])))
+        {
+            p++;
+            n++;
+        }
+        else if(p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            resume = n;
+        }
+        else if(star != string::npos)
+        {
+            // let the last '*' take one more character
+            p = star + 1;
+            n = ++resume;
+        }
+        else
+            return false;
+    }
+    while(p < pattern.size() && pattern[p] == '*')
+        p++;
+    return p == pattern.size();
+}
+
+struct InputPaths::Source{
+    virtual bool next(string& path) = 0;
+    virtual ~Source(){}
+};
+
+namespace {
+
+struct ArgSource : InputPaths::Source{
+    vector<string> paths;
+    size_t pos = 0;
+
+    bool next(string& path) override
+    {
+        if(pos == paths.size())
+            return false;
+        path = paths[pos++];
+        return true;
+    }
+};
+
+struct ListSource : InputPaths::Source{
+    unique_ptr<ifstream> file;
+    istream* inp;
+
+    explicit ListSource(const string& list):
+        inp(&cin)
+    {
+        if(list != "-")
+        {
+            file.reset(new ifstream(list));
+            if(!*file)
+                throw logic_error("cannot open list '" + list + "'");
+            inp = file.get();
+        }
+    }
+
+    bool next(string& path) override
+    {
+        while(getline(*inp, path))
+        {
+            while(!path.empty() && isspace((unsigned char)path.back()))
+                path.pop_back();
+            if(!path.empty())
+                return true;
+        }
+        return false;
+    }
+};
+
+// depth-first walk, a directory is listed only when the walk gets to it
+struct DirSource : InputPaths::Source{
+    struct Level{
+        vector<fs::path> entries;
+        size_t pos;
+    };
+    vector<Level> stack;
+    string glob;
+
+    DirSource(const string& dir, const string& glob_):
+        glob(glob_)
+    {
+        if(!fs::is_directory(dir))
+            throw logic_error("'" + dir + "' is not a directory");
+        push(dir);
+    }
+
+    void push(const fs::path& dir)
+    {
+        Level level{{}, 0};
+        try {
+            for(auto it = fs::directory_iterator(dir); it != fs::directory_iterator(); ++it)
+                level.entries.push_back(it->path());
+        }
+        catch(fs::filesystem_error& e)
+        {
+            LOG(WARN) << e.what() << endline;
+        }
+        sort(level.entries.begin(), level.entries.end());
+        stack.push_back(move(level));
+    }
+
+    bool next(string& path) override
+    {
+        while(!stack.empty())
+        {
+            Level& top = stack.back();
+            if(top.pos == top.entries.size())
+            {
+                stack.pop_back();
+                continue;
+            }
+            fs::path entry = top.entries[top.pos++];
+            boost::system::error_code ec;
+            auto st = fs::symlink_status(entry, ec);
+            if(fs::is_directory(st))
+                push(entry); // 'top' is invalid from here on
+            else if(globMatch(glob, entry.filename().string()) && fs::is_regular_file(fs::status(entry, ec)))
+            {
+                path = entry.string();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+}
+
+InputPaths::InputPaths():
+    current(0){}
+
+InputPaths::InputPaths(const vector<string>& paths):
+    current(0)
+{
+    for(auto& p : paths)
+        add(p);
+}
+
+void InputPaths::add(const string& path)
+{
+    auto args = sources.empty() ? nullptr : dynamic_cast<ArgSource*>(sources.back().get());
+    if(!args)
+    {
+        args = new ArgSource();
+        sources.emplace_back(args);
+    }
+    args->paths.push_back(path);
+}
+
+void InputPaths::addList(const string& list)
+{
+    sources.emplace_back(new ListSource(list));
+}
+
+void InputPaths::addDir(const string& dir, const string& glob)
+{
+    sources.emplace_back(new DirSource(dir, glob));
+}
+
+bool InputPaths::next(string& path)
+{
+    for(; current < sources.size(); current++)
+        if(sources[current]->next(path))
+            return true;
+    return false;
+}
+
+InputPaths::~InputPaths(){}
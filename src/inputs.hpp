@@ -0,0 +1,34 @@
+// Input paths from the command line, list files and directory walks
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+
+// true if 'name' matches 'pattern' with '*' and '?' wildcards, case-insensitive
+bool globMatch(const std::string& pattern, const std::string& name);
+
+// Produces input paths one at a time so that encoding can start before
+// a long list is read or a big directory tree is walked. Paths come in order
+// of command line inputs, then lists, then directories.
+// Not thread-safe, see runOrderedFrom
+class InputPaths{
+public:
+    InputPaths();
+    explicit InputPaths(const std::vector<std::string>& paths);
+    void add(const std::string& path);
+    // a file with one path per line, "-" for stdin
+    void addList(const std::string& list);
+    // files under 'dir' recursively whose names match 'glob',
+    // sorted by name within each directory
+    void addDir(const std::string& dir, const std::string& glob);
+    // next path, false when there are no more
+    bool next(std::string& path);
+    // no inputs given at all i.e. data is to be read from stdin
+    bool empty()const{ return sources.empty(); }
+    ~InputPaths();
+
+    struct Source;
+private:
+    std::vector<std::unique_ptr<Source>> sources;
+    size_t current;
+};
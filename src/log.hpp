@@ -15,6 +15,26 @@ extern int logLevel;
 
 struct EndLine{};
 
+template<class T1, class T2>
+std::ostream& operator<<(std::ostream& os, const std::pair<T1, T2>& arg){
+    return os << '(' << arg.first << ", "<<arg.second << ')';
+}
+
+// TODO: generalize to any container with begin/end
+template<class T>
+std::ostream& operator<<(std::ostream& os, const std::vector<T>& arg){
+    os << '[';
+    bool first = true;
+    for(auto& a : arg){
+        if(first)
+            first = false;
+        else
+            os << ", ";
+        os << a;
+    }
+    return os << ']';
+}
+
 struct LogSink{
     int level;
     LogSink(int lvl): level(lvl){}
@@ -49,24 +69,3 @@ enum {
     DEBUG = 5,
     TRACE = 6
 };
-
-template<class T1, class T2>
-std::ostream& operator<<(std::ostream& os, const std::pair<T1, T2>& arg){
-    return os << '(' << arg.first << ", "<<arg.second << ')';
-}
-
-// TODO: generalize to any container with begin/end
-template<class T>
-std::ostream& operator<<(std::ostream& os, const std::vector<T>& arg){
-    os << '[';
-    bool first = true;
-    for(auto& a : arg){
-        if(first)
-            first = false;
-        else
-            os << ", ";
-        os << a;
-    }
-    return os << ']';
-}
-
@@ -6,13 +6,31 @@
 #include <stdio.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <string.h>
+#include <boost/utility/string_ref.hpp>
 #include "cxxopts.hpp"
 #include "fcsp.hpp"
 #include "ctab.hpp"
 #include "log.hpp"
+#include "mapped.hpp"
+#include "ordered.hpp"
+#include "decompress.hpp"
+#include "corpus.hpp"
+#include "smiles.hpp"
+#include "inputs.hpp"
+#include "prefetch.hpp"
+#include "sdfindex.hpp"
+#include "dbimage.hpp"
+#include "embedded.hpp"
+#include "generated.hpp"
 
 using namespace std;
+using boost::string_ref;
 
 #ifdef __linux__
 #include <unistd.h>
@@ -46,18 +64,421 @@ vector<string> descrPaths()
 
 namespace fs = boost::filesystem;
 
-void processFile(FCSP& fcsp, const string& path, ostream& out)
+// MOL file contents, plain or compressed, named by the file name
+template<class Encoder>
+void processData(Encoder& fcsp, const string& path, const char* data, size_t size, ostream& out)
+{
+    if(isCompressed(data, size))
+    {
+        DecompressStream inp(data, size);
+        fcsp.load(inp);
+    }
+    else
+        fcsp.load(data, size);
+    fcsp.process(out, fs::path(path).filename().string());
+}
+
+// Encoder is FCSP or Packer, the latter collects molecules for `pack`
+template<class Encoder>
+void processFile(Encoder& fcsp, const string& path, ostream& out)
 {
     LOG(INFO) << "Reading " << path << endline;
-    fs::path fpath(path);
-    ifstream f(path);
-    if(!f){
-        LOG(ERROR) << "ERROR: cannot open '" << path << "'\n";
+    try {
+        MappedFile f(path);
+        processData(fcsp, path, f.data(), f.size(), out);
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << e.what() << endline;
+    }
+}
+
+// same as processFile for a file read by FilePrefetcher
+void processLoaded(FCSP& fcsp, const LoadedFile& file, ostream& out)
+{
+    LOG(INFO) << "Reading " << file.path << endline;
+    if(!file.error.empty())
+    {
+        LOG(ERROR) << file.error << endline;
+        return;
+    }
+    try {
+        processData(fcsp, file.path, file.data.data(), file.data.size(), out);
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << e.what() << endline;
+    }
+}
+
+// encode SDF records one by one as they are read, rows are named
+// by 'idProp' property or by record number if it's empty or missing
+template<class Encoder>
+void processSdf(Encoder& fcsp, SdfReader& reader, const string& idProp, ostream& out)
+{
+    SdfProps props;
+    for(;;)
+    {
+        try {
+            if(!fcsp.load(reader, props))
+                break;
+            string name = to_string(reader.count());
+            auto id = props.find(idProp);
+            if(id != props.end() && !id->second.empty())
+                name = id->second.front();
+            fcsp.process(out, name);
+        }
+        catch(std::exception &e)
+        {
+            LOG(ERROR) << "Record " << reader.count() << ": " << e.what() << endline;
+        }
+    }
+}
+
+template<class Encoder>
+void processSdfFile(Encoder& fcsp, const string& path, const string& idProp, ostream& out)
+{
+    LOG(INFO) << "Reading SDF " << path << endline;
+    try {
+        MappedFile f(path);
+        if(isCompressed(f.data(), f.size()))
+        {
+            DecompressStream inp(f.data(), f.size());
+            SdfReader reader(inp, TOPOLOGY);
+            processSdf(fcsp, reader, idProp, out);
+        }
+        else
+        {
+            SdfReader reader(f.data(), f.size(), 0, TOPOLOGY);
+            processSdf(fcsp, reader, idProp, out);
+        }
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << e.what() << endline;
+    }
+}
+
+// big inputs are split in chunks of about this size to encode in parallel
+const size_t chunkSize = 4 << 20;
+
+// encode chunks of records on 'threads' threads, output follows record order
+// count(chunk) is the number of records in a chunk and
+// process(fcsp, chunk, first, out) encodes a chunk with records numbered from 'first'
+template<class Count, class Process>
+void processChunks(const FCSPOptions& conf, const vector<TextChunk>& chunks,
+    size_t threads, Count count, Process process, ostream& out)
+{
+    LOG(INFO) << "CPUs: " << threads << " chunks: " << chunks.size() << endline;
+    // records are numbered across the whole file - a thread counts records
+    // of its chunk and waits for the counts of all the chunks before it
+    vector<size_t> counts(chunks.size()), first(chunks.size() + 1, 0);
+    vector<bool> counted(chunks.size(), false);
+    size_t known = 0; // first[0..known] are final
+    mutex lock;
+    condition_variable changed;
+    auto worker = [&](){
+        auto fcsp = make_shared<FCSP>(conf);
+        return [&, fcsp](size_t i, ostream& os){
+            const TextChunk& chunk = chunks[i];
+            size_t n = count(chunk);
+            size_t base;
+            {
+                unique_lock<mutex> guard(lock);
+                counts[i] = n;
+                counted[i] = true;
+                for(; known < chunks.size() && counted[known]; known++)
+                    first[known + 1] = first[known] + counts[known];
+                changed.notify_all();
+                changed.wait(guard, [&](){ return known >= i; });
+                base = first[i];
+            }
+            process(*fcsp, chunk, base, os);
+        };
+    };
+    runOrdered(chunks.size(), min(threads, chunks.size()), worker, out);
+}
+
+// same output as processSdfFile but chunks of records are parsed and
+// encoded on 'threads' threads
+void processSdfParallel(const FCSPOptions& conf, const string& path, const string& idProp,
+    size_t threads, ostream& out)
+{
+    LOG(INFO) << "Reading SDF " << path << endline;
+    try {
+        MappedFile f(path);
+        if(isCompressed(f.data(), f.size()))
+        {
+            // compressed data can't be split, records are streamed
+            // while decompression runs on its own thread
+            FCSP fcsp(conf);
+            DecompressStream inp(f.data(), f.size());
+            SdfReader reader(inp, TOPOLOGY);
+            processSdf(fcsp, reader, idProp, out);
+            return;
+        }
+        processChunks(conf, splitSdf(f.data(), f.size(), chunkSize), threads,
+            [](const TextChunk& chunk){
+                return countSdfRecords(chunk.data, chunk.size);
+            },
+            [&idProp](FCSP& fcsp, const TextChunk& chunk, size_t first, ostream& os){
+                SdfReader reader(chunk.data, chunk.size, first, TOPOLOGY);
+                processSdf(fcsp, reader, idProp, os);
+            }, out);
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << e.what() << endline;
+    }
+}
+
+// records picked from indexed SDF files, see `fcss-2a index`
+struct RecordSelection{
+    std::vector<std::pair<size_t, size_t>> ranges; // 0-based [first, last)
+    std::vector<string> ids;
+
+    bool empty()const{ return ranges.empty() && ids.empty(); }
+};
+
+// IDs one per line, '-' for stdin
+vector<string> readIds(const string& list)
+{
+    ifstream file;
+    if(list != "-")
+    {
+        file.open(list);
+        if(!file)
+            throw logic_error("cannot open ID list '" + list + "'");
+    }
+    istream& inp = list == "-" ? cin : file;
+    vector<string> ids;
+    for(string line; getline(inp, line); )
+    {
+        while(!line.empty() && isspace((unsigned char)line.back()))
+            line.pop_back();
+        if(!line.empty())
+            ids.push_back(line);
+    }
+    return ids;
+}
+
+// encode only the records of 'path' chosen by 'selection', ranges first then IDs
+// in the order given, each record is found through the index and parsed in place
+void processSdfSelected(const FCSPOptions& conf, const string& path, const RecordSelection& selection,
+    const string& idProp, size_t threads, ostream& out)
+{
+    string indexPath = SdfIndex::pathFor(path);
+    LOG(INFO) << "Reading SDF " << path << " through " << indexPath << endline;
+    try {
+        SdfIndex index(indexPath);
+        MappedFile f(path, MappedFile::RANDOM);
+        if(isCompressed(f.data(), f.size()))
+            throw logic_error("'" + path + "' is compressed, records can't be picked from it");
+        vector<size_t> records;
+        for(auto& r : selection.ranges)
+        {
+            if(r.first >= index.size())
+                LOG(WARN) << "Record " << r.first + 1 << " is past the end of " << path << endline;
+            for(size_t i = r.first; i < min(r.second, index.size()); i++)
+                records.push_back(i);
+        }
+        if(!selection.ids.empty() && index.property().empty())
+            throw logic_error("'" + indexPath + "' has no IDs, make it with `index --id <property>`");
+        for(auto& id : selection.ids)
+        {
+            auto found = index.find(id);
+            if(found.empty())
+                LOG(WARN) << index.property() << " " << id << " is not in " << path << endline;
+            records.insert(records.end(), found.begin(), found.end());
+        }
+        // located up front so that a stale index is reported once
+        vector<string_ref> texts;
+        for(auto i : records)
+            texts.push_back(index.record(f.data(), f.size(), i));
+        // a job is a batch of records to keep ordering overhead low
+        const size_t batch = 256;
+        size_t jobs = (records.size() + batch - 1) / batch;
+        LOG(INFO) << "CPUs: " << threads << " records: " << records.size() << endline;
+        auto worker = [&](){
+            auto fcsp = make_shared<FCSP>(conf);
+            return [&, fcsp](size_t job, ostream& os){
+                size_t stop = min(records.size(), (job + 1) * batch);
+                for(size_t k = job * batch; k < stop; k++)
+                {
+                    SdfReader reader(texts[k].data(), texts[k].size(), records[k], TOPOLOGY);
+                    processSdf(*fcsp, reader, idProp, os);
+                }
+            };
+        };
+        runOrdered(jobs, min(threads, jobs), worker, out);
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << e.what() << endline;
+    }
+}
+
+// `fcss-2a index [--id ID] inputs...` writes an index next to each SDF file
+// for picking records with --records and --ids
+void indexSdf(InputPaths& inputs, const string& idProp)
+{
+    if(inputs.empty())
+        throw logic_error("index needs SDF files, stdin can't be indexed");
+    for(string path; inputs.next(path); )
+    {
+        try {
+            MappedFile f(path);
+            if(isCompressed(f.data(), f.size()))
+                throw logic_error("'" + path + "' is compressed, records can't be picked from it");
+            SdfIndexWriter index(idProp);
+            index.scan(f.data(), f.size());
+            string output = SdfIndex::pathFor(path);
+            ofstream out(output, ios::binary);
+            if(!out)
+                throw logic_error("cannot open '" + output + "' for writing");
+            index.write(out);
+            out.close();
+            if(!out)
+                throw logic_error("failed to write '" + output + "'");
+            LOG(INFO) << "Indexed " << index.size() << " records of " << path << endline;
+        }
+        catch(std::exception &e)
+        {
+            LOG(ERROR) << e.what() << endline;
+        }
+    }
+}
+
+// encode a line of SMILES file: SMILES optionally followed by a name,
+// rows are named by line number if there is no name, blank lines are skipped
+template<class Encoder>
+void processSmilesLine(Encoder& fcsp, string_ref line, size_t lineNo, ostream& out)
+{
+    auto blank = [](char c){ return c == ' ' || c == '\t' || c == '\r'; };
+    while(!line.empty() && blank(line.front()))
+        line.remove_prefix(1);
+    while(!line.empty() && blank(line.back()))
+        line.remove_suffix(1);
+    if(line.empty())
         return;
+    size_t stop = 0;
+    while(stop < line.size() && !blank(line[stop]))
+        stop++;
+    auto name = line.substr(stop);
+    while(!name.empty() && blank(name.front()))
+        name.remove_prefix(1);
+    try {
+        fcsp.loadSmiles(line.data(), stop);
+        fcsp.process(out, name.empty() ? to_string(lineNo) : name.to_string());
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << "Line " << lineNo << ": " << e.what() << endline;
+    }
+}
+
+// lines of 'data' numbered after 'first'
+template<class Encoder>
+void processSmiles(Encoder& fcsp, const char* data, size_t size, size_t first, ostream& out)
+{
+    const char* end = data + size;
+    for(const char* p = data; p < end; )
+    {
+        auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if(!eol)
+            eol = end;
+        processSmilesLine(fcsp, string_ref(p, eol - p), ++first, out);
+        p = eol + 1;
+    }
+}
+
+template<class Encoder>
+void processSmiles(Encoder& fcsp, istream& inp, ostream& out)
+{
+    string line;
+    for(size_t n = 1; getline(inp, line); n++)
+        processSmilesLine(fcsp, line, n, out);
+}
+
+// chunks of whole lines
+vector<TextChunk> splitLines(const char* data, size_t size, size_t target)
+{
+    vector<TextChunk> chunks;
+    const char* end = data + size;
+    for(const char* p = data; p < end; )
+    {
+        const char* stop = end;
+        if((size_t)(end - p) > target)
+        {
+            stop = static_cast<const char*>(memchr(p + target, '\n', end - p - target));
+            stop = stop ? stop + 1 : end;
+        }
+        chunks.push_back(TextChunk{p, (size_t)(stop - p)});
+        p = stop;
+    }
+    return chunks;
+}
+
+size_t countLines(const TextChunk& chunk)
+{
+    size_t n = count(chunk.data, chunk.data + chunk.size, '\n');
+    if(chunk.size && chunk.data[chunk.size - 1] != '\n')
+        n++;
+    return n;
+}
+
+void processSmilesFile(const FCSPOptions& conf, const string& path, size_t threads, ostream& out)
+{
+    LOG(INFO) << "Reading SMILES " << path << endline;
+    try {
+        MappedFile f(path);
+        if(isCompressed(f.data(), f.size()))
+        {
+            FCSP fcsp(conf);
+            DecompressStream inp(f.data(), f.size());
+            processSmiles(fcsp, inp, out);
+            return;
+        }
+        processChunks(conf, splitLines(f.data(), f.size(), chunkSize), threads, countLines,
+            [](FCSP& fcsp, const TextChunk& chunk, size_t first, ostream& os){
+                processSmiles(fcsp, chunk.data, chunk.size, first, os);
+            }, out);
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << e.what() << endline;
     }
+}
+
+// encode a corpus made by `pack` on 'threads' threads, all of them share
+// the mapped file, output follows the corpus order
+void processCorpus(const FCSPOptions& conf, const string& path, size_t threads, ostream& out)
+{
+    LOG(INFO) << "Reading corpus " << path << endline;
     try {
-        fcsp.load(f);
-        fcsp.process(out, fpath.filename().string());
+        Corpus corpus(path);
+        // a job is a batch of molecules to keep ordering overhead low
+        const size_t batch = 256;
+        size_t jobs = (corpus.size() + batch - 1) / batch;
+        LOG(INFO) << "CPUs: " << threads << " molecules: " << corpus.size() << endline;
+        auto worker = [&](){
+            auto fcsp = make_shared<FCSP>(conf);
+            return [&, fcsp](size_t job, ostream& os){
+                size_t stop = min(corpus.size(), (job + 1) * batch);
+                for(size_t i = job * batch; i < stop; i++)
+                {
+                    try {
+                        fcsp->load(corpus, i);
+                        fcsp->process(os, corpus.name(i).to_string());
+                    }
+                    catch(std::exception &e)
+                    {
+                        LOG(ERROR) << "Molecule " << i + 1 << ": " << e.what() << endline;
+                    }
+                }
+            };
+        };
+        runOrdered(jobs, min(threads, jobs), worker, out);
     }
     catch(std::exception &e)
     {
@@ -65,6 +486,171 @@ void processFile(FCSP& fcsp, const string& path, ostream& out)
     }
 }
 
+// how MOL files get to the encoders, see --io
+enum class FileIO{
+    URING,   // read ahead in batches through io_uring
+    THREADS, // read ahead by loader threads
+    MMAP     // each encoder maps its next file
+};
+
+FileIO toFileIO(const string& io)
+{
+    if(io == "uring") return FileIO::URING;
+    if(io == "threads") return FileIO::THREADS;
+    if(io == "mmap") return FileIO::MMAP;
+    throw logic_error("No such I/O mode "+io);
+}
+
+// encode MOL files on 'threads' threads, output follows the order of inputs,
+// paths are taken as the threads need them
+void processFiles(const FCSPOptions& conf, InputPaths& inputs, FileIO io, size_t threads, ostream& out)
+{
+    LOG(INFO) << "CPUs: " << threads << endline;
+    auto start = chrono::steady_clock::now();
+    size_t files = 0;
+    if(io == FileIO::MMAP)
+    {
+        runOrderedFrom<string>(threads,
+            [&](string& path){
+                if(!inputs.next(path))
+                    return false;
+                files++;
+                return true;
+            },
+            [&conf](){
+                auto fcsp = make_shared<FCSP>(conf);
+                return [fcsp](size_t, string& path, ostream& os){
+                    processFile(*fcsp, path, os);
+                };
+            }, out);
+    }
+    else
+    {
+        FilePrefetcher prefetcher(inputs,
+            io == FileIO::URING ? PrefetchMode::URING : PrefetchMode::THREADS, threads);
+        LOG(INFO) << "Reading files with " << prefetcher.backend() << endline;
+        runOrderedFrom<LoadedFile>(threads,
+            [&](LoadedFile& file){
+                if(!prefetcher.next(file))
+                    return false;
+                files++;
+                return true;
+            },
+            [&conf](){
+                auto fcsp = make_shared<FCSP>(conf);
+                return [fcsp](size_t, LoadedFile& file, ostream& os){
+                    processLoaded(*fcsp, file, os);
+                    file.data = string(); // don't hold on to the buffer
+                };
+            }, out);
+    }
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    LOG(INFO) << "Encoded " << files << " files in " << secs << "s, "
+        << (secs > 0 ? files / secs : 0) << " files/s" << endline;
+}
+
+// stands in for FCSP when packing, molecules are collected into a corpus
+// under the same names they would be encoded with
+struct Packer{
+    CorpusWriter corpus;
+    ChemGraph graph;
+
+    void load(istream& inp)
+    {
+        GraphSink sink(graph);
+        readMol(inp, sink, TOPOLOGY);
+    }
+
+    void load(const char* data, size_t size)
+    {
+        GraphSink sink(graph);
+        readMol(data, size, sink, TOPOLOGY);
+    }
+
+    bool load(SdfReader& reader, SdfProps& props)
+    {
+        GraphSink sink(graph);
+        return reader.next(sink, props);
+    }
+
+    void loadSmiles(const char* data, size_t size)
+    {
+        graph = readSmiles(string_ref(data, size));
+    }
+
+    void process(ostream&, const string& name)
+    {
+        corpus.add(graph, name);
+    }
+};
+
+void packSmilesFile(Packer& packer, const string& path)
+{
+    LOG(INFO) << "Reading SMILES " << path << endline;
+    try {
+        MappedFile f(path);
+        if(isCompressed(f.data(), f.size()))
+        {
+            DecompressStream inp(f.data(), f.size());
+            processSmiles(packer, inp, cout);
+        }
+        else
+            processSmiles(packer, f.data(), f.size(), 0, cout);
+    }
+    catch(std::exception &e)
+    {
+        LOG(ERROR) << e.what() << endline;
+    }
+}
+
+// `fcss-2a pack -o <corpus> [--sdf|--smiles] inputs...`
+// parses inputs once into a corpus that is encoded with --corpus
+void pack(InputPaths& inputs, bool sdf, bool smiles, const string& idProp, const string& output)
+{
+    Packer packer;
+    if(inputs.empty())
+    {
+        DecompressStream inp(cin);
+        if(sdf)
+        {
+            SdfReader reader(inp, TOPOLOGY);
+            processSdf(packer, reader, idProp, cout);
+        }
+        else if(smiles)
+            processSmiles(packer, inp, cout);
+        else
+        {
+            packer.load(inp);
+            packer.process(cout, "");
+        }
+    }
+    for(string inp; inputs.next(inp); )
+    {
+        if(sdf)
+            processSdfFile(packer, inp, idProp, cout);
+        else if(smiles)
+            packSmilesFile(packer, inp);
+        else
+            processFile(packer, inp, cout);
+    }
+    ofstream out(output, ios::binary);
+    if(!out)
+        throw logic_error("cannot open '" + output + "' for writing");
+    packer.corpus.write(out);
+    out.close();
+    if(!out)
+        throw logic_error("failed to write '" + output + "'");
+    LOG(INFO) << "Packed " << packer.corpus.size() << " molecules into " << output << endline;
+}
+
+ReplacementMatcher toReplacementMatcher(const string& m)
+{
+    if(m == "anchored") return ReplacementMatcher::ANCHORED;
+    if(m == "trie") return ReplacementMatcher::TRIE;
+    if(m == "vf2") return ReplacementMatcher::VF2;
+    throw logic_error("No such matcher "+m);
+}
+
 FCSPFMT toFCSPFMT(string fmt)
 {
     if(fmt == "json") return FCSPFMT::JSON;
@@ -73,32 +659,53 @@ FCSPFMT toFCSPFMT(string fmt)
     throw logic_error("No such format "+fmt);
 }
 
-FCSPOptions configure(vector<string> paths, bool long41, FCSPFMT fmt)
+// descriptor DB of directory 'p', its compiled image if there is one and
+// 'image' is set, otherwise the text files; returns what was loaded
+string loadDescriptors(const string& p, bool image, DescriptorDB& db)
+{
+    auto descrBase = fs::path(p);
+    auto sources = descriptorSources(p);
+    auto compiled = (descrBase / descriptorImageName).string();
+    if(image && fs::exists(compiled))
+    {
+        try {
+            readDescriptorImage(compiled, sources, db);
+            return compiled;
+        }
+        catch(exception &e){
+            LOG(WARN) << e.what() << ", reading text DB instead" << endline;
+        }
+    }
+    ifstream descr1(sources[0].c_str());
+    if(!descr1)
+      throw logic_error("Failed to open descr1.csv DB, check your -d option");
+    ifstream descr2(sources[1].c_str());
+    if(!descr2)
+        throw logic_error("Failed to open descr2.sdf DB, check -d option");
+    ifstream repl(sources[2].c_str());
+    if(!repl)
+        throw logic_error("Failed to open replacement.sdf DB, check -d option");
+    db.first = read1stOrder(descr1);
+    db.second = read2ndOrder(descr2);
+    db.replacements = readReplacements(repl);
+    return p;
+}
+
+// 'image' - prefer compiled images of the DB (see `compile`) to text files
+FCSPOptions configure(vector<string> paths, bool long41, FCSPFMT fmt, bool image = true,
+    string* from = nullptr)
 {
     auto default_ex = logic_error("DB not found in any of search paths");
     string found = "";
     exception& ex = default_ex;
-    vector<LevelOne> order1;
-    vector<LevelTwo> order2;
-    vector<Replacement> replacements;
+    auto db = make_shared<DescriptorDB>();
     for(auto p : paths)
     {
         LOG(DEBUG) << "Trying to load DCs from " << p << endline;
         try{
-            auto descrBase = fs::path(p);
-            ifstream descr1((descrBase / "descr1.csv").c_str());
-            if(!descr1)
-              throw logic_error("Failed to open descr1.csv DB, check your -d option");
-            ifstream descr2((descrBase / "descr2.sdf").c_str());
-            if(!descr2)
-                throw logic_error("Failed to open descr2.sdf DB, check -d option");
-            ifstream repl((descrBase / "replacement.sdf").c_str());
-            if(!repl)
-                throw logic_error("Failed to open replacement.sdf DB, check -d option");
-            order1 = read1stOrder(descr1);
-            order2 = read2ndOrder(descr2);
-            replacements = readReplacements(repl);
-            found = p;
+            found = loadDescriptors(p, image, *db);
+            if(from)
+                *from = p;
             break;
         }
         catch(exception &te){
@@ -109,20 +716,111 @@ FCSPOptions configure(vector<string> paths, bool long41, FCSPFMT fmt)
         throw ex;
     else
         LOG(INFO) << "Loaded DCs from "<< found << endline;
-    return {order1, order2, replacements, long41, fmt};
+    db->prepare();
+    return {db, long41, fmt};
+}
+
+// descriptor DB compiled into the executable (`scons --embed-db`),
+// nothing is read from disk; false if there is none
+bool configureEmbedded(bool long41, FCSPFMT fmt, FCSPOptions& conf)
+{
+#ifdef EMBED_DB
+    auto& e = embeddedDescriptors;
+    istringstream descr1(string(e[0].data, e[0].size));
+    istringstream descr2(string(e[1].data, e[1].size));
+    istringstream repl(string(e[2].data, e[2].size));
+    auto db = make_shared<DescriptorDB>();
+    db->first = read1stOrder(descr1);
+    db->second = read2ndOrder(descr2);
+    db->replacements = readReplacements(repl);
+    db->prepare();
+    LOG(INFO) << "Loaded DCs embedded in the executable" << endline;
+    conf = {db, long41, fmt};
+    return true;
+#else
+    return false;
+#endif
+}
+
+// `fcss-2a compile [-d DIR] [-o FILE]` compiles the text DB found the usual way
+// into an image that is loaded instead of it, by default next to the text files
+void compile(const vector<string>& paths, string output)
+{
+    string dir;
+    auto conf = configure(paths, true, FCSPFMT::JSON, false, &dir);
+    if(output.empty())
+        output = (fs::path(dir) / descriptorImageName).string();
+    ofstream out(output, ios::binary);
+    if(!out)
+        throw logic_error("cannot open '" + output + "' for writing");
+    writeDescriptorImage(*conf.db, descriptorSources(dir), out);
+    out.close();
+    if(!out)
+        throw logic_error("failed to write '" + output + "'");
+    LOG(INFO) << "Compiled DCs from " << dir << " into " << output << endline;
+}
+
+// `fcss-2a generate [-d DIR] -o FILE` writes matchers for the text DB in DIR
+// as C++ source, `scons --gen-matchers` builds them into the executable
+void generate(const string& dir, const string& output)
+{
+    auto conf = configure({dir}, true, FCSPFMT::JSON, false);
+    ofstream out(output);
+    if(!out)
+        throw logic_error("cannot open '" + output + "' for writing");
+    writeGeneratedMatchers(*conf.db, out);
+    out.close();
+    if(!out)
+        throw logic_error("failed to write '" + output + "'");
+    LOG(INFO) << "Generated matchers for DCs from " << dir << " into " << output << endline;
 }
 
 int main(int argc, char* argv[])
 {
     bool long41 = true;
+    ReplacementMatcher matcher = ReplacementMatcher::TRIE;
+    bool interpreted = false;
     int threads = 0;
+    bool sdf = false;
+    bool smiles = false;
+    bool corpus = false;
+    string command; // pack, index, compile or generate
+    string idProp;
+    string output;
     string descriptors;
+    bool explicitDb = false; // -d given, even if it's "."
     FCSPFMT fmt = FCSPFMT::JSON;
-    vector<string> inputs;
+    vector<string> inputs, lists, dirs;
+    string glob;
+    FileIO io = FileIO::URING;
+    RecordSelection selection;
+    // subcommands take the same options as encoding
+    if(argc > 1 && (strcmp(argv[1], "pack") == 0 || strcmp(argv[1], "index") == 0
+            || strcmp(argv[1], "compile") == 0 || strcmp(argv[1], "generate") == 0))
+    {
+        command = argv[1];
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
     cxxopts::Options options(argv[0], " - example command line options");
     options.add_options()
     ("h,help", "Print help")
     ("input", "List of MOL files to encode", cxxopts::value<vector<string>>())
+    ("list", "File with input paths one per line, '-' for stdin", cxxopts::value<vector<string>>(), "FILE")
+    ("dir", "Directory to take inputs from recursively, see --glob", cxxopts::value<vector<string>>(), "DIR")
+    ("glob", "File name pattern for --dir, default is *.mol, *.sdf, *.smi or *.pack by input type", cxxopts::value<string>(), "PATTERN")
+    ("sdf", "Inputs are multi-record SDF files, encoded one record at a time")
+    ("smiles", "Inputs are SMILES files, one SMILES per line optionally followed by a name")
+    ("corpus", "Inputs are binary corpora made by `pack` subcommand")
+    ("o,output", "File to write by `pack` (corpus), `compile` (DB image) or `generate` (C++ source)", cxxopts::value<string>(), "FILE")
+    ("id", "SDF property to name records by, default is record number", cxxopts::value<string>(), "ID")
+    ("records", "Encode only these records of indexed SDF files e.g. 1-100,250,1000-", cxxopts::value<string>(), "RANGES")
+    ("ids", "Encode only records of indexed SDF files with IDs listed in a file, '-' for stdin", cxxopts::value<string>(), "FILE")
+    ("io", "How MOL files are read: uring (falls back to threads if not available), threads, mmap", cxxopts::value<string>(), "uring")
+    ("matcher", "How replacement descriptors are found: trie (all at once from DC atoms), anchored (one by one), vf2", cxxopts::value<string>(), "trie")
+    ("interpreted", "Read patterns from the descriptor DB tables even if matchers generated of it are built in")
+    ("d,descriptors", "Directory with descriptor DB, searched before the default ones", cxxopts::value<string>(), "DIR")
     ("t,threads", "Number of threads to use", cxxopts::value<int>(), "0")
     ("v,verbosity", "Level of verbosity", cxxopts::value<int>(), "0")
     ("f,format", "Output format: txt, csv, json", cxxopts::value<string>(), "json");
@@ -139,10 +837,62 @@ int main(int argc, char* argv[])
         {
             inputs = options["input"].as<vector<string>>();    
         }
+        if (options.count("list"))
+        {
+            lists = options["list"].as<vector<string>>();
+        }
+        if (options.count("dir"))
+        {
+            dirs = options["dir"].as<vector<string>>();
+        }
+        if (options.count("glob"))
+        {
+            glob = options["glob"].as<string>();
+        }
+        if (options.count("io"))
+        {
+            io = toFileIO(options["io"].as<string>());
+        }
+        if (options.count("matcher"))
+        {
+            matcher = toReplacementMatcher(options["matcher"].as<string>());
+        }
+        if (options.count("interpreted"))
+        {
+            interpreted = true;
+        }
         if (options.count("format"))
         {
             fmt = toFCSPFMT(options["format"].as<string>());
         }
+        if (options.count("sdf"))
+        {
+            sdf = true;
+        }
+        if (options.count("smiles"))
+        {
+            smiles = true;
+        }
+        if (options.count("corpus"))
+        {
+            corpus = true;
+        }
+        if (options.count("output"))
+        {
+            output = options["output"].as<string>();
+        }
+        if (options.count("id"))
+        {
+            idProp = options["id"].as<string>();
+        }
+        if (options.count("records"))
+        {
+            selection.ranges = parseRanges(options["records"].as<string>());
+        }
+        if (options.count("ids"))
+        {
+            selection.ids = readIds(options["ids"].as<string>());
+        }
         if (options.count("threads"))
         {
             threads = options["threads"].as<int>();
@@ -151,7 +901,8 @@ int main(int argc, char* argv[])
         {
             logLevel = options["verbosity"].as<int>();
         }
-        descriptors = options.count("descriptors") ? options["descriptors"].as<string>() : ".";
+        explicitDb = options.count("descriptors") != 0;
+        descriptors = explicitDb ? options["descriptors"].as<string>() : ".";
     }
     catch(cxxopts::OptionException &e) {
         cerr << "Argument parsing error: ";
@@ -164,38 +915,100 @@ int main(int argc, char* argv[])
         return 1;
     }
     try {
-        auto paths = descrPaths();
-        if(descriptors != ".")
-            paths.insert(paths.begin(), descriptors);
-        auto conf = configure(paths, long41, fmt);
+        // paths are read and directories walked as the inputs get processed
+        InputPaths sources(inputs);
+        for(auto& list : lists)
+            sources.addList(list);
+        if(glob.empty())
+            glob = sdf || command == "index" || !selection.empty() ? "*.sdf" : smiles ? "*.smi" : corpus ? "*.pack" : "*.mol";
+        for(auto& dir : dirs)
+            sources.addDir(dir, glob);
+        if(command == "pack") {
+            if(output.empty())
+                throw logic_error("pack needs an output file, see -o");
+            pack(sources, sdf, smiles, idProp, output);
+            return 0;
+        }
+        if(command == "index") {
+            indexSdf(sources, idProp);
+            return 0;
+        }
+        if(command == "generate") {
+            if(output.empty())
+                throw logic_error("generate needs an output file, see -o");
+            generate(descriptors, output);
+            return 0;
+        }
+        // the DB built in, if any, is used unless -d is given
+        FCSPOptions conf;
+        if(explicitDb || command == "compile" || !configureEmbedded(long41, fmt, conf)) {
+            auto paths = descrPaths();
+            if(explicitDb)
+                paths.insert(paths.begin(), descriptors);
+            if(command == "compile") {
+                compile(paths, output);
+                return 0;
+            }
+            conf = configure(paths, long41, fmt);
+        }
+        conf.matcher = matcher;
+        conf.generated = interpreted ? nullptr : generatedMatchers(*conf.db);
+        if(conf.generated)
+            LOG(INFO) << "Using matchers generated of the DB at build time" << endline;
         
-        if(inputs.empty()) {
+        if(corpus) {
+            size_t n = threads <= 0 ? thread::hardware_concurrency() : threads;
+            for(string inp; sources.next(inp); )
+                processCorpus(conf, inp, n, cout);
+        }
+        else if(smiles) {
+            size_t n = threads <= 0 ? thread::hardware_concurrency() : threads;
+            if(sources.empty())
+            {
+                FCSP fcsp(conf);
+                DecompressStream inp(cin);
+                processSmiles(fcsp, inp, cout);
+            }
+            for(string inp; sources.next(inp); )
+                processSmilesFile(conf, inp, n, cout);
+        }
+        else if(!selection.empty()) {
+            // records are picked from SDF files through their indices
+            if(sources.empty())
+                throw logic_error("--records and --ids need indexed SDF files");
+            size_t n = threads <= 0 ? thread::hardware_concurrency() : threads;
+            for(string inp; sources.next(inp); )
+                processSdfSelected(conf, inp, selection, idProp, n, cout);
+        }
+        else if(sdf) {
+            size_t n = threads <= 0 ? thread::hardware_concurrency() : threads;
+            if(n > 1 && !sources.empty()) {
+                // each file is split in chunks that are encoded in parallel
+                for(string inp; sources.next(inp); )
+                    processSdfParallel(conf, inp, idProp, n, cout);
+            }
+            else {
+                // streaming - output goes straight to stdout record by record
+                FCSP fcsp(conf);
+                if(sources.empty())
+                {
+                    DecompressStream inp(cin);
+                    SdfReader reader(inp, TOPOLOGY);
+                    processSdf(fcsp, reader, idProp, cout);
+                }
+                for(string inp; sources.next(inp); )
+                    processSdfFile(fcsp, inp, idProp, cout);
+            }
+        }
+        else if(sources.empty()) {
             FCSP fcsp(conf);
-            fcsp.load(cin);
+            DecompressStream inp(cin);
+            fcsp.load(inp);
             fcsp.process(cout);
         }
         else {
             size_t n = threads <= 0 ? thread::hardware_concurrency() : threads;
-            size_t batch = (inputs.size() + n - 1) / n;
-            size_t batches = (inputs.size()+ batch - 1)/ batch;
-            LOG(INFO) << "CPUs: " << n << " batch-size: " << batch << endline;
-            vector<thread> threads(batches);
-            vector<stringstream> streams(batches);
-            for (size_t i = 0; i < batches; i ++) {
-                size_t start = i * batch;
-                size_t stop = start + batch > inputs.size() ? inputs.size() : start + batch;
-                auto t = thread([&inputs, &streams, &conf, i, start, stop](){
-                    FCSP fcsp(conf);
-                    for_each(inputs.begin()+start, inputs.begin()+stop, [&streams, &fcsp, i](string& inp){
-                        processFile(fcsp, inp, streams[i]);
-                    });
-                });
-                threads[i] = move(t);
-            }
-            for (size_t i = 0; i < batches; i++) {
-                threads[i].join();
-                cout << streams[i].str();
-            }
+            processFiles(conf, sources, io, n, cout);
         }
     }
     catch(std::exception& e) {
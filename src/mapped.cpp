@@ -0,0 +1,81 @@
+#include <stdexcept>
+#include "mapped.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const std::string& path, Access access):
+    ptr(nullptr), len(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::logic_error("cannot open '" + path + "'");
+    struct stat st;
+    if(fstat(fd, &st) < 0)
+    {
+        close(fd);
+        throw std::logic_error("cannot stat '" + path + "'");
+    }
+    if(!S_ISREG(st.st_mode))
+    {
+        // pipes, FIFOs and the like have no size to map, they are read to the end
+        char buf[64 << 10];
+        ssize_t n;
+        while((n = read(fd, buf, sizeof(buf))) != 0)
+        {
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+            {
+                close(fd);
+                throw std::logic_error("cannot read '" + path + "'");
+            }
+            fallback.append(buf, n);
+        }
+        close(fd);
+        ptr = fallback.data();
+        len = fallback.size();
+        return;
+    }
+    len = st.st_size;
+    if(len) // can't map an empty file
+    {
+        void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED)
+        {
+            close(fd);
+            throw std::logic_error("cannot map '" + path + "'");
+        }
+        madvise(p, len, access == RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL);
+        ptr = static_cast<const char*>(p);
+    }
+    close(fd); // mapping stays valid
+}
+
+MappedFile::~MappedFile()
+{
+    if(ptr && ptr != fallback.data())
+        munmap(const_cast<char*>(ptr), len);
+}
+
+#else
+#include <fstream>
+#include <iterator>
+
+MappedFile::MappedFile(const std::string& path, Access access)
+{
+    std::ifstream f(path, std::ios::binary);
+    if(!f)
+        throw std::logic_error("cannot open '" + path + "'");
+    fallback.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    ptr = fallback.data();
+    len = fallback.size();
+}
+
+MappedFile::~MappedFile(){}
+
+#endif
@@ -0,0 +1,26 @@
+// Read-only view of a whole file, memory mapped where supported
+#pragma once
+#include <string>
+
+class MappedFile{
+public:
+    // how the file is going to be read, a hint for read-ahead
+    enum Access{ SEQUENTIAL, RANDOM };
+    // throws std::logic_error if the file can't be opened
+    explicit MappedFile(const std::string& path, Access access = SEQUENTIAL);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const char* data()const{ return ptr; }
+    size_t size()const{ return len; }
+    ~MappedFile();
+private:
+    const char* ptr;
+    size_t len;
+    std::string fallback; // file contents if mapping is not available
+};
+
+// a run of whole records (SDF records, lines) of a larger text
+struct TextChunk{
+    const char* data;
+    size_t size;
+};
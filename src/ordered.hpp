@@ -0,0 +1,110 @@
+// Parallel jobs with output written in order of job number
+#pragma once
+#include <vector>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Runs jobs produced by 'next(item)' on 'threads' threads until it returns false.
+// Each thread calls 'factory()' once to get its worker i.e.
+// void(size_t job, Item& item, std::ostream& out) so that per-thread state
+// (like FCSP) is created on that thread. Jobs are numbered in the order
+// 'next' produces them, it's called by one thread at a time and need not know
+// how many jobs there are, so jobs can be generated lazily e.g. while reading a list.
+// Outputs are written to 'out' in job order as soon as all previous jobs
+// are done. At most 'window' finished outputs are kept in memory,
+// threads that are too far ahead wait.
+template<class Item, class Next, class Factory>
+void runOrderedFrom(size_t threads, Next next, Factory factory, std::ostream& out, size_t window = 0)
+{
+    if(threads < 1)
+        threads = 1;
+    if(window < threads)
+        window = 2 * threads;
+    std::mutex lock, taking;
+    std::condition_variable changed;
+    size_t taken = 0, written = 0;
+    bool exhausted = false;
+    std::vector<std::string> slots(window);
+    std::vector<bool> ready(window, false);
+    std::vector<std::thread> pool;
+    for(size_t t = 0; t < threads; t++)
+    {
+        pool.emplace_back([&](){
+            auto work = factory();
+            std::stringstream buf;
+            Item item;
+            for(;;)
+            {
+                size_t job;
+                {
+                    // producing a job may block (e.g. reading stdin),
+                    // the writer keeps going meanwhile
+                    std::lock_guard<std::mutex> take(taking);
+                    if(exhausted)
+                        break;
+                    if(!next(item))
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        exhausted = true;
+                        changed.notify_all();
+                        break;
+                    }
+                    std::lock_guard<std::mutex> guard(lock);
+                    job = taken++;
+                }
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&](){ return job < written + window; });
+                }
+                buf.str("");
+                work(job, item, buf);
+                std::unique_lock<std::mutex> guard(lock);
+                slots[job % window] = buf.str();
+                ready[job % window] = true;
+                changed.notify_all();
+            }
+        });
+    }
+    for(;;)
+    {
+        std::string chunk;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&](){
+                return ready[written % window] || (exhausted && written == taken);
+            });
+            if(!ready[written % window])
+                break;
+            chunk.swap(slots[written % window]);
+            ready[written % window] = false;
+            written++;
+            changed.notify_all();
+        }
+        out << chunk;
+    }
+    for(auto& t : pool)
+        t.join();
+}
+
+// Runs jobs 0..count-1, worker is void(size_t job, std::ostream& out)
+// otherwise the same as runOrderedFrom
+template<class Factory>
+void runOrdered(size_t count, size_t threads, Factory factory, std::ostream& out, size_t window = 0)
+{
+    size_t i = 0;
+    runOrderedFrom<size_t>(threads,
+        [&](size_t& job){
+            if(i == count)
+                return false;
+            job = i++;
+            return true;
+        },
+        [&](){
+            auto work = factory();
+            return [work](size_t job, size_t&, std::ostream& os) mutable { work(job, os); };
+        }, out, window);
+}
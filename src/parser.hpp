@@ -3,70 +3,152 @@
 #include <sstream>
 #include <stdexcept>
 #include <iostream>
+#include <iterator>
+#include <type_traits>
 #include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 #include <cmath>
+#include <boost/utility/string_ref.hpp>
 
 using std::pow;
 using std::string;
+using boost::string_ref;
 
 void error(const string& msg);
 void warning(const string& msg);
 
-struct FormatSpec
+// Fixed-column line formats are spelled out as in CTFile specification
+// e.g. "aaabbb" or "xxxxx.xxxx yyy": a run of the same letter or digit is
+// a field, two runs of the same marker joined by '.' are a fixed point number
+// and anything else is a literal. Layout<Fmt> turns Fmt::format into
+// a table of columns at compile time.
+struct Column
 {
-    int n, m;
+    int offset; // of the first char in line
+    int n, m;   // width of integral and fractional parts, m = 0 if not fixed point
+    int lead;   // number of literal chars right before the field
 };
 
-const char* fetchSpec(const char* fmt, FormatSpec& spec);
+// a field that is jumped over without conversion
+struct Skip{};
 
+namespace layout {
+
+constexpr bool isMarker(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+// position after the run of f[p] chars
+constexpr int runEnd(const char* f, int p)
+{
+    return f[p + 1] == f[p] ? runEnd(f, p + 1) : p + 1;
+}
+
+constexpr bool hasFraction(const char* f, int p)
+{
+    return f[runEnd(f, p)] == '.' && f[runEnd(f, p) + 1] == f[p];
+}
+
+constexpr int fieldEnd(const char* f, int p)
+{
+    return hasFraction(f, p) ? runEnd(f, runEnd(f, p) + 1) : runEnd(f, p);
+}
+
+constexpr int skipLiterals(const char* f, int p)
+{
+    return f[p] && !isMarker(f[p]) ? skipLiterals(f, p + 1) : p;
+}
+
+// position right after k fields
+constexpr int fieldsEnd(const char* f, int k)
+{
+    return k == 0 ? 0 : fieldEnd(f, skipLiterals(f, fieldsEnd(f, k - 1)));
+}
+
+constexpr int fieldStart(const char* f, int k)
+{
+    return skipLiterals(f, fieldsEnd(f, k));
+}
+
+constexpr int fieldCount(const char* f, int p = 0)
+{
+    return f[skipLiterals(f, p)] ? 1 + fieldCount(f, fieldEnd(f, skipLiterals(f, p))) : 0;
+}
+
+constexpr Column column(const char* f, int k)
+{
+    return Column{
+        fieldStart(f, k),
+        runEnd(f, fieldStart(f, k)) - fieldStart(f, k),
+        hasFraction(f, fieldStart(f, k)) ? fieldEnd(f, fieldStart(f, k)) - runEnd(f, fieldStart(f, k)) - 1 : 0,
+        fieldStart(f, k) - fieldsEnd(f, k)
+    };
+}
+
+template<int... I> struct Indices{};
+template<int N, int... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...>{};
+template<int... I> struct MakeIndices<0, I...>{ typedef Indices<I...> type; };
+
+}
+
+// Fmt is a struct with 'static constexpr const char* format'
+template<class Fmt, class Idx = typename layout::MakeIndices<layout::fieldCount(Fmt::format)>::type>
+struct Layout;
+
+template<class Fmt, int... I>
+struct Layout<Fmt, layout::Indices<I...>> : Fmt
+{
+    static constexpr int size = sizeof...(I);
+    static constexpr Column columns[sizeof...(I)] = { layout::column(Fmt::format, I)... };
+};
+
+template<class Fmt, int... I>
+constexpr Column Layout<Fmt, layout::Indices<I...>>::columns[];
+
+// Parser over a contiguous block of text (e.g. memory mapped file),
+// lines and fields are returned as views into the original buffer
 struct Parser
 {
+    // zero-copy, 'data' must outlive the parser
+    Parser(const char* data, size_t size)
+    {
+        reset(data, size);
+    }
+
+    // reads the whole stream in a buffer owned by the parser
     Parser(std::istream& in) :
-    inp(in)
+    owned(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>())
     {
-        next();
-        lineCnt = 0;
+        reset(owned.data(), owned.size());
     }
 
-    // read a line and fit prefix to 'fmt'
-    void matchfln(const char* fmt)
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+
+    // start over on another block of text
+    void reset(const char* data, size_t size)
     {
-        while (*fmt){
-            if (front() != *fmt)
-                error("format error - expected " + string(1, *fmt));
-            fmt++;
-            next();
-        }
-        skipLine();
+        cur = data;
+        end = data + size;
+        lineCnt = 0;
     }
 
-    // read a line and fit prefix to 'fmt' poppulating values of args
-    template<class F, class... T>
-    void matchfln(const char* fmt, F& a, T&... args)
+    // read a line of Fmt format poppulating values of args
+    template<class Fmt, class... T>
+    void matchfln(T&... args)
     {
-        while (*fmt)
-        {
-            FormatSpec spec;
-            fmt = fetchSpec(fmt, spec);
-            if (spec.n) //fetched spec
-            {
-                if (spec.m)
-                    parse(a, spec.n, spec.m);
-                else
-                    parse(a, spec.n);
-                return matchfln(fmt, args...);
-            }
-            char marker = *fmt;
-            if (front() != marker)
-                error("format error - pattern mismatch expected:" + string(1, front()));
-            fmt++;
-            next();
-        }
+        typedef Layout<Fmt> L;
+        static_assert(sizeof...(T) == L::size, "number of values must match fields in the format");
+        if (eof())
+            errorEof();
+        fields<L, 0>(line(), args...);
     }
 
-    string quotedString(char delim = ',')
+    string_ref quotedString(char delim = ',')
     {
-        string field;
+        string_ref field;
         if (front() == '"')
         {
             next();
@@ -80,26 +162,33 @@ struct Parser
         return field;
     }
 
-    string line()
+    string_ref line()
     {
         return readUpTo('\n');
     }
 
     bool eof()
     {
-        return front_ == -1;
+        return cur == end;
+    }
+
+    // bytes not parsed yet
+    size_t left()const
+    {
+        return end - cur;
     }
 
 private:
-    std::istream& inp;
-    int front_;
+    string owned; // only used if constructed from a stream
+    const char* cur;
+    const char* end;
     int lineCnt;
 
     char front()
     {
-        if (front_ == -1)
+        if (cur == end)
             errorEof();
-        return front_;
+        return *cur;
     }
 
     void error(const string& msg)
@@ -116,116 +205,140 @@ private:
 
     void next()
     {
-        front_ = inp.get();
+        cur++;
     }
 
-    int skipSpace(int maxSpace)
+    string_ref readUpTo(char delim)
     {
-        for (int i = 0; i < maxSpace; i++)
+        auto stop = static_cast<const char*>(memchr(cur, delim, end - cur));
+        if (!stop)
+            stop = end;
+        string_ref field(cur, stop - cur);
+        if (delim == '\n')
         {
-            if (!isspace(front()))
-                return i;
-            next();
+            lineCnt++;
+            //strip \r if any
+            if(field.size() > 1 && field.back() == '\r')
+                field.remove_suffix(1);
         }
-        return maxSpace;
+        cur = stop == end ? end : stop + 1;
+        return field;
     }
 
-    void skipLine()
+    template<class L, int I>
+    void fields(string_ref)
     {
-        while (front() != '\n')
-            next();
-        lineCnt++;
-        next();
     }
 
-    string readUpTo(char delim)
+    template<class L, int I, class F, class... T>
+    void fields(string_ref ln, F& a, T&... args)
     {
-        string line;
-        while (!eof() && front() != delim)
+        static_assert(L::columns[I].m == 0 || std::is_same<F, double>::value || std::is_same<F, Skip>::value,
+            "fixed point field needs a double");
+        const Column& col = L::columns[I];
+        for (int i = col.offset - col.lead; i < col.offset; i++)
         {
-            line.push_back(front());
-            next();
+            if (i >= (int)ln.size() || ln[i] != L::format[i])
+                error("format error - pattern mismatch expected:" + string(1, L::format[i]));
         }
-        if (delim == '\n')
-        {
-            lineCnt++;
-            //strip \r if any
-            if(line.size() > 1 && line[line.size()-1] == '\r')
-                line.resize(line.size()-1);
-        }
-        if (!eof())
-            next();
-        return line;
+        // chars past the end of line are treated as blanks
+        int stop = col.offset + (col.m ? col.n + col.m + 1 : col.n);
+        if (stop > (int)ln.size())
+            stop = ln.size();
+        const char* p = ln.data() + col.offset;
+        const char* e = col.offset < stop ? ln.data() + stop : p;
+        parse(a, p, e);
+        fields<L, I + 1>(ln, args...);
     }
 
-    template<class T>
-    void parse(T&, int)
+    static bool digit(char c)
     {
-        error("unsupported type combination");
+        return c >= '0' && c <= '9';
     }
 
-    template<class T>
-    void parse(T&, int, int)
+    static bool space(char c)
     {
-        error("unsupported type combination");
+        return c == ' ' || (c >= '\t' && c <= '\r');
     }
 
-    void parse(string& s, int n)
+    static const char* skipSpace(const char* p, const char* e)
+    {
+        while (p < e && space(*p))
+            p++;
+        return p;
+    }
+
+    void parse(Skip&, const char*, const char*)
     {
-        s.clear();
-        int k = skipSpace(n);
-        for (int i = k; i < n; i++)
-        {
-            s.push_back(front());
-            next();
-        }
+    }
+
+    void parse(string& s, const char* p, const char* e)
+    {
+        p = skipSpace(p, e);
+        s.assign(p, e - p);
     }
 
     template<int N>
-    void parse(char(&arr)[N], int n)
+    void parse(char(&arr)[N], const char* p, const char* e)
     {
-        if (n + 1 > N)
+        p = skipSpace(p, e);
+        if (e - p + 1 > N)
             error("format - wrongly sized array");
-        int k = skipSpace(n);
-        for (int i = k; i < n; i++)
-        {
-            arr[i - k] = front();
-            next();
-        }
-        arr[n - k] = 0;
+        memcpy(arr, p, e - p);
+        arr[e - p] = 0;
     }
 
-    void parse(int& target, int n)
+    void parse(int& target, const char* p, const char* e)
     {
         int value = 0;
-        for (int i = 0; i < n; i++)
+        for (; p < e; p++)
         {
-            if (isdigit(front()))
-            {
-                value = front() - '0' + value * 10;
-            }
-            else if (!isspace(front())) //may skip space as well            
-                error("format error - expected digit:" + string(1, front()));
-            else if (front() == '\n')
-                break; //HACK for bad formats
-            next();
+            if (digit(*p))
+                value = *p - '0' + value * 10;
+            else if (!space(*p)) //may skip space as well
+                error("format error - expected digit:" + string(1, *p));
         }
         target = value;
     }
 
-    void parse(double& target, int n, int m)
+    // fixed point number e.g. "  -12.3456"
+    void parse(double& target, const char* p, const char* e)
     {
-        char buf[64];
-        int k = n + m + 1;
-        //assert(n + m + 2 < 64);
-        for (int i = 0; i < k; i++)
+        const char* start = p;
+        while (p < e && *p == ' ')
+            p++;
+        bool negative = p < e && *p == '-';
+        if (negative)
+            p++;
+        // integer mantissa divided by exact power of 10 is rounded
+        // the same way as strtod does for decimal input
+        long long mantissa = 0;
+        int digits = 0, fraction = -1;
+        for (; p < e; p++)
         {
-            buf[i] = front();
-            next();
+            if (digit(*p))
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits++;
+                if (fraction >= 0)
+                    fraction++;
+            }
+            else if (*p == '.' && fraction < 0)
+                fraction = 0;
+            else
+                break;
+        }
+        if (p != e || digits == 0 || digits > 15 || fraction > 9)
+        {
+            // anything unusual - let the C library deal with it
+            target = atof(string(start, e).c_str());
+            return;
         }
-        buf[k] = 0;
-        target = atof(buf);
-        //target = negative ? -ret : ret;
+        static const double scale[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+        double value = (double)mantissa;
+        if (fraction > 0)
+            value /= scale[fraction];
+        target = negative ? -value : value;
     }
 
 };
@@ -326,6 +326,11 @@ bool Code::matches(Code code)const
     return wildMatch(index, code.index);
 }
 
+int Code::atoms()
+{
+    return (int)atomList.size();
+}
+
 const string& Code::symbol()const
 {
     return index >= 0 ? atomList[index].symbol : wildList[-index - 1].symbol;
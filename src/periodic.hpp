@@ -81,6 +81,9 @@ public:
     bool matches(Code code)const;
     //ref to a symbol in a global table
     const std::string& symbol()const;
+    // number of atom symbols known so far i.e. valid codes are 0..atoms()-1,
+    // new ones are added as they are first seen
+    static int atoms();
     bool isWild()const;
     int code()const{ return index; }
     int charge()const{ return _charge; }
@@ -0,0 +1,454 @@
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "prefetch.hpp"
+#include "log.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+using namespace std;
+
+// files taken from inputs at once, also the io_uring queue size
+static const size_t batchSize = 64;
+// first read of a file, most MOL files fit
+static const size_t readSize = 16 << 10;
+
+static string cannotOpen(const string& path)
+{
+    return "cannot open '" + path + "'";
+}
+
+static string cannotRead(const string& path, int err)
+{
+    return "cannot read '" + path + "': " + strerror(err);
+}
+
+// plain blocking read of a whole file
+static void readFile(LoadedFile& file)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        file.error = cannotOpen(file.path);
+        return;
+    }
+    struct stat st;
+    size_t size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    file.data.resize(max(size + 1, readSize)); // +1 to see the end right away
+    size_t got = 0;
+    for(;;)
+    {
+        if(got == file.data.size())
+            file.data.resize(2 * got);
+        ssize_t n = read(fd, &file.data[got], file.data.size() - got);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0)
+        {
+            file.error = cannotRead(file.path, errno);
+            break;
+        }
+        if(n == 0)
+            break;
+        got += n;
+    }
+    close(fd);
+    file.data.resize(got);
+#else
+    FILE* f = fopen(file.path.c_str(), "rb");
+    if(!f)
+    {
+        file.error = cannotOpen(file.path);
+        return;
+    }
+    char buf[readSize];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        file.data.append(buf, n);
+    fclose(f);
+#endif
+}
+
+#ifdef HAVE_IO_URING
+
+// Minimal io_uring on raw system calls, only what loading a batch needs:
+// queue up to 'entries' operations, submit them and wait for all completions
+struct FilePrefetcher::Ring{
+    int fd;
+    unsigned entries;
+    void* sq;
+    void* cq;
+    size_t sqSize, cqSize;
+    io_uring_sqe* sqes;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe* cqes;
+    unsigned queued, inflight; // entries not submitted yet and not completed yet
+    bool broken; // in-flight entries couldn't be waited for, see drain()
+
+    explicit Ring(unsigned size):
+        fd(-1), sq(MAP_FAILED), cq(MAP_FAILED), sqes((io_uring_sqe*)MAP_FAILED),
+        queued(0), inflight(0), broken(false)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd = syscall(__NR_io_uring_setup, size, &p);
+        if(fd < 0)
+            throw logic_error(string("io_uring is not available: ") + strerror(errno));
+        entries = p.sq_entries;
+        sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if(single)
+            sqSize = cqSize = max(sqSize, cqSize);
+        sq = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        cq = single ? sq : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        sqes = (io_uring_sqe*)mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if(sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            release();
+            throw logic_error("io_uring rings can't be mapped");
+        }
+        char* s = (char*)sq;
+        sqHead = (unsigned*)(s + p.sq_off.head);
+        sqTail = (unsigned*)(s + p.sq_off.tail);
+        sqMask = (unsigned*)(s + p.sq_off.ring_mask);
+        sqArray = (unsigned*)(s + p.sq_off.array);
+        char* c = (char*)cq;
+        cqHead = (unsigned*)(c + p.cq_off.head);
+        cqTail = (unsigned*)(c + p.cq_off.tail);
+        cqMask = (unsigned*)(c + p.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(c + p.cq_off.cqes);
+    }
+
+    ~Ring()
+    {
+        release();
+    }
+
+    void release()
+    {
+        if(sqes != MAP_FAILED)
+            munmap(sqes, entries * sizeof(io_uring_sqe));
+        if(cq != MAP_FAILED && cq != sq)
+            munmap(cq, cqSize);
+        if(sq != MAP_FAILED)
+            munmap(sq, sqSize);
+        if(fd >= 0)
+            close(fd);
+    }
+
+    // next free submission entry, there is room for 'entries' between waits
+    io_uring_sqe* queue(int op, size_t userData)
+    {
+        unsigned tail = *sqTail;
+        unsigned i = tail & *sqMask;
+        io_uring_sqe* sqe = &sqes[i];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = op;
+        sqe->user_data = userData;
+        sqArray[i] = i;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        queued++;
+        return sqe;
+    }
+
+    // submit queued entries and call 'complete(user_data, res)' for each of them
+    template<class Complete>
+    void run(Complete complete)
+    {
+        while(queued)
+        {
+            int n = syscall(__NR_io_uring_enter, fd, queued, queued, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0)
+                throw logic_error(string("io_uring_enter: ") + strerror(errno));
+            queued -= n;
+            inflight += n;
+        }
+        while(inflight)
+            if(!reap(complete) && wait() < 0 && errno != EINTR)
+                throw logic_error(string("io_uring_enter: ") + strerror(errno));
+    }
+
+    // after run() failed: drops entries that weren't submitted and waits for
+    // the rest, they still write to their buffers, false if that fails too
+    template<class Complete>
+    bool drain(Complete complete)
+    {
+        __atomic_store_n(sqTail, *sqTail - queued, __ATOMIC_RELEASE);
+        queued = 0;
+        while(inflight)
+        {
+            if(!reap(complete) && wait() < 0 && errno != EINTR)
+            {
+                broken = true;
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    int wait()
+    {
+        return syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    // completions that are there, false if none
+    template<class Complete>
+    bool reap(Complete complete)
+    {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        if(head == tail)
+            return false;
+        for(; head != tail && inflight; head++, inflight--)
+        {
+            io_uring_cqe& cqe = cqes[head & *cqMask];
+            complete(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return true;
+    }
+};
+
+// open, read and close a batch of files, a few system calls for all of them
+static void readBatch(FilePrefetcher::Ring& ring, vector<LoadedFile>& files)
+{
+    vector<int> fds(files.size(), -1);
+    vector<size_t> got(files.size(), 0);
+    vector<bool> opened(files.size(), false); // to be closed
+    int stage = IORING_OP_OPENAT; // of entries in flight
+    try {
+        for(size_t i = 0; i < files.size(); i++)
+        {
+            auto sqe = ring.queue(IORING_OP_OPENAT, i);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)files[i].path.c_str();
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        }
+        ring.run([&](size_t i, int res){
+            fds[i] = res;
+            opened[i] = res >= 0;
+        });
+        // reads go in rounds until every file hits its end
+        stage = IORING_OP_READ;
+        vector<size_t> reading;
+        for(size_t i = 0; i < files.size(); i++)
+        {
+            if(fds[i] >= 0)
+            {
+                files[i].data.resize(readSize);
+                reading.push_back(i);
+            }
+        }
+        while(!reading.empty())
+        {
+            for(auto i : reading)
+            {
+                auto sqe = ring.queue(IORING_OP_READ, i);
+                sqe->fd = fds[i];
+                sqe->addr = (uintptr_t)&files[i].data[got[i]];
+                sqe->len = files[i].data.size() - got[i];
+                sqe->off = got[i];
+            }
+            vector<size_t> more;
+            ring.run([&](size_t i, int res){
+                if(res < 0)
+                    files[i].error = cannotRead(files[i].path, -res);
+                else if(res > 0)
+                {
+                    got[i] += res;
+                    if(got[i] == files[i].data.size())
+                        files[i].data.resize(2 * got[i]);
+                    more.push_back(i);
+                }
+            });
+            reading.swap(more);
+        }
+        stage = IORING_OP_CLOSE;
+        for(size_t i = 0; i < files.size(); i++)
+        {
+            if(fds[i] < 0)
+                continue;
+            files[i].data.resize(got[i]);
+            ring.queue(IORING_OP_CLOSE, i)->fd = fds[i];
+        }
+        ring.run([&](size_t i, int){ opened[i] = false; });
+    }
+    catch(std::exception&)
+    {
+        // the caller reads the batch again, not before the kernel is done
+        // with its buffers, and files opened so far are closed
+        bool drained = ring.drain([&](size_t i, int res){
+            if(stage == IORING_OP_OPENAT)
+            {
+                fds[i] = res;
+                opened[i] = res >= 0;
+            }
+            else if(stage == IORING_OP_CLOSE)
+                opened[i] = false;
+        });
+        for(size_t i = 0; i < files.size(); i++)
+            if(opened[i])
+                close(fds[i]);
+        // reads that may still come are left buffers no one uses
+        if(!drained && stage == IORING_OP_READ)
+        {
+            auto lost = new vector<string>;
+            for(auto& f : files)
+                lost->push_back(move(f.data));
+        }
+        throw;
+    }
+    // failed opens are retried the plain way for a proper error
+    // or in case the kernel has no IORING_OP_OPENAT
+    for(size_t i = 0; i < files.size(); i++)
+        if(fds[i] < 0)
+            readFile(files[i]);
+}
+
+#else
+
+struct FilePrefetcher::Ring{};
+
+#endif
+
+FilePrefetcher::FilePrefetcher(InputPaths& inputs_, PrefetchMode mode, size_t threads):
+    inputs(inputs_), taken(0), delivered(0), exhausted(false), stop(false), pos(0)
+{
+#ifdef HAVE_IO_URING
+    if(mode == PrefetchMode::URING)
+    {
+        try {
+            rings.emplace_back(new Ring(batchSize));
+        }
+        catch(std::exception& e)
+        {
+            LOG(WARN) << e.what() << ", falling back to loader threads" << endline;
+        }
+    }
+#endif
+    size_t count = rings.empty() ? max<size_t>(threads, 1) : rings.size();
+    ahead = 2 * count + 2;
+    for(size_t i = 0; i < count; i++)
+    {
+        Ring* ring = rings.empty() ? nullptr : rings[i].get();
+        loaders.emplace_back([this, ring](){ load(ring); });
+    }
+}
+
+const char* FilePrefetcher::backend()const
+{
+    return rings.empty() ? "threads" : "io_uring";
+}
+
+void FilePrefetcher::load(Ring* ring)
+{
+    for(;;)
+    {
+        vector<LoadedFile> batch;
+        size_t id;
+        {
+            lock_guard<mutex> take(taking);
+            if(exhausted)
+                return;
+            LoadedFile file;
+            while(batch.size() < batchSize && inputs.next(file.path))
+                batch.push_back(file);
+            lock_guard<mutex> guard(lock);
+            if(batch.empty())
+            {
+                exhausted = true;
+                changed.notify_all();
+                return;
+            }
+            id = taken++;
+        }
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [&](){ return id < delivered + ahead || stop; });
+            if(stop)
+                return;
+        }
+#ifdef HAVE_IO_URING
+        if(ring)
+        {
+            try {
+                readBatch(*ring, batch);
+            }
+            catch(std::exception& e)
+            {
+                LOG(ERROR) << e.what() << endline;
+                if(ring->broken)
+                {
+                    LOG(WARN) << "io_uring is given up, files are read the plain way" << endline;
+                    ring = nullptr;
+                }
+                for(auto& f : batch)
+                {
+                    f.data.clear();
+                    f.error.clear();
+                    readFile(f);
+                }
+            }
+        }
+        else
+#endif
+        for(auto& f : batch)
+            readFile(f);
+        lock_guard<mutex> guard(lock);
+        done[id] = move(batch);
+        changed.notify_all();
+    }
+}
+
+bool FilePrefetcher::next(LoadedFile& file)
+{
+    while(pos == current.size())
+    {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [this](){
+            return done.count(delivered) || (exhausted && delivered == taken);
+        });
+        auto it = done.find(delivered);
+        if(it == done.end())
+            return false;
+        current = move(it->second);
+        done.erase(it);
+        delivered++;
+        pos = 0;
+        changed.notify_all();
+    }
+    file = move(current[pos++]);
+    return true;
+}
+
+FilePrefetcher::~FilePrefetcher()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stop = true;
+    }
+    changed.notify_all();
+    for(auto& t : loaders)
+        t.join();
+}
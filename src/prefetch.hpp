@@ -0,0 +1,53 @@
+// Reading many small input files ahead of the encoders
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "inputs.hpp"
+
+// whole contents of an input file or why it couldn't be read
+struct LoadedFile{
+    std::string path;
+    std::string data;
+    std::string error; // empty if read fine
+};
+
+enum class PrefetchMode{
+    URING,  // batches of open/read/close through io_uring (Linux), falls back to THREADS
+    THREADS // loader threads with blocking reads
+};
+
+// Takes paths from 'inputs' in batches and loads them on background threads
+// so that encoders get files already in memory instead of waiting on
+// open/read/close for each small file. With io_uring a batch is read with
+// a few system calls on a single loader thread.
+// A bounded number of batches is kept ahead of the consumer.
+class FilePrefetcher{
+public:
+    FilePrefetcher(InputPaths& inputs, PrefetchMode mode, size_t threads);
+    // next file in order of inputs, false when there are no more,
+    // to be called by one thread at a time (see runOrderedFrom)
+    bool next(LoadedFile& file);
+    // "io_uring" or "threads"
+    const char* backend()const;
+    ~FilePrefetcher();
+
+    struct Ring;
+private:
+    void load(Ring* ring);
+
+    InputPaths& inputs;
+    std::vector<std::unique_ptr<Ring>> rings; // one per loader thread if io_uring is used
+    std::vector<std::thread> loaders;
+    std::mutex taking, lock;
+    std::condition_variable changed;
+    std::map<size_t, std::vector<LoadedFile>> done; // loaded batches by number
+    size_t taken, delivered, ahead;
+    bool exhausted, stop;
+    std::vector<LoadedFile> current; // batch being consumed
+    size_t pos;
+};
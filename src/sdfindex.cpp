@@ -0,0 +1,187 @@
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include "sdfindex.hpp"
+#include "ctab.hpp"
+#include "sections.hpp"
+
+using namespace std;
+using boost::string_ref;
+
+void error(const string& msg);
+
+static const char indexMagic[8] = { 'F', 'C', 'S', 'S', 'S', 'I', 'D', 'X' };
+static const uint32_t indexVersion = 1;
+
+// section offsets from the start of file
+struct SdfIndexLayout{
+    uint64_t property, offsets, ids, byId, values;
+    bool valid; // sections fit in the file and fill it up
+
+    SdfIndexLayout(const SdfIndexHeader& h, uint64_t size)
+    {
+        FileSections s(sizeof(SdfIndexHeader), size);
+        property = s.section(h.propertyBytes, 1);
+        offsets = s.section(h.records, sizeof(uint64_t), 1);
+        ids = s.section(h.records, sizeof(uint64_t), 1);
+        byId = s.section(h.records, sizeof(uint64_t));
+        values = s.section(h.valueBytes, 1);
+        valid = s.exact();
+    }
+};
+
+SdfIndexWriter::SdfIndexWriter(const string& idProp):
+    property(idProp), ids(1, 0), sourceSize(0){}
+
+void SdfIndexWriter::scan(const char* data, size_t size)
+{
+    const char* end = data + size;
+    for(const char* p = data; ; )
+    {
+        size_t n = sdfRecordSize(p, end - p);
+        if(!n)
+            break;
+        offsets.push_back(p - data);
+        if(!property.empty())
+            values += sdfProperty(p, n, property);
+        ids.push_back(values.size());
+        p += n;
+    }
+    sourceSize = size;
+}
+
+void SdfIndexWriter::write(ostream& out)const
+{
+    SdfIndexHeader header;
+    memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.propertyBytes = property.size();
+    header.records = offsets.size();
+    header.sourceSize = sourceSize;
+    header.valueBytes = values.size();
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pad(out, sizeof(header));
+    out.write(property.data(), property.size());
+    pad(out, property.size());
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(&sourceSize), sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(uint64_t));
+    auto id = [this](uint64_t i){
+        return string_ref(values.data() + ids[i], ids[i + 1] - ids[i]);
+    };
+    vector<uint64_t> byId(offsets.size());
+    iota(byId.begin(), byId.end(), 0);
+    stable_sort(byId.begin(), byId.end(), [&](uint64_t a, uint64_t b){ return id(a) < id(b); });
+    out.write(reinterpret_cast<const char*>(byId.data()), byId.size() * sizeof(uint64_t));
+    out.write(values.data(), values.size());
+}
+
+static bool endsWith(string_ref s, string_ref tail)
+{
+    return s.size() >= tail.size() && s.substr(s.size() - tail.size()) == tail;
+}
+
+string SdfIndex::pathFor(const string& sdf)
+{
+    return sdf + ".idx";
+}
+
+SdfIndex::SdfIndex(const string& path_):
+    file(path_, MappedFile::RANDOM), path(path_)
+{
+    const char* base = file.data();
+    if(file.size() < sizeof(SdfIndexHeader) || memcmp(base, indexMagic, sizeof(indexMagic)) != 0)
+        error("'" + path + "' is not an SDF index");
+    header = reinterpret_cast<const SdfIndexHeader*>(base);
+    if(header->version != indexVersion)
+        error("'" + path + "' has unsupported index version " + to_string(header->version));
+    SdfIndexLayout layout(*header, file.size());
+    if(!layout.valid)
+        error("'" + path + "' is truncated or corrupted");
+    offsets = reinterpret_cast<const uint64_t*>(base + layout.offsets);
+    ids = reinterpret_cast<const uint64_t*>(base + layout.ids);
+    byId = reinterpret_cast<const uint64_t*>(base + layout.byId);
+    values = base + layout.values;
+    propertyName = base + layout.property;
+    if(offsets[header->records] != header->sourceSize || ids[header->records] != header->valueBytes)
+        error("'" + path + "' has inconsistent offsets");
+}
+
+string_ref SdfIndex::property()const
+{
+    return string_ref(propertyName, header->propertyBytes);
+}
+
+string_ref SdfIndex::record(const char* data, size_t size, size_t i)const
+{
+    assert(i < header->records);
+    if(size != header->sourceSize)
+        error("'" + path + "' is out of date, the SDF file has changed since it was indexed");
+    uint64_t first = offsets[i], next = offsets[i + 1];
+    if(first > next || next > size)
+        error("'" + path + "' has corrupted offset of record " + to_string(i + 1));
+    // a record starts right after '$$$$' line of the previous one
+    if(first != 0 && !endsWith(string_ref(data, first), "$$$$\n")
+            && !endsWith(string_ref(data, first), "$$$$\r\n"))
+        error("'" + path + "' is out of date, record " + to_string(i + 1) + " is not where it was indexed");
+    return string_ref(data + first, next - first);
+}
+
+string_ref SdfIndex::id(size_t i)const
+{
+    assert(i < header->records);
+    uint64_t first = ids[i], next = ids[i + 1];
+    if(first > next || next > header->valueBytes)
+        error("'" + path + "' has corrupted ID of record " + to_string(i + 1));
+    return string_ref(values + first, next - first);
+}
+
+vector<size_t> SdfIndex::find(string_ref key)const
+{
+    auto end = byId + header->records;
+    auto at = [this](uint64_t i){
+        if(i >= header->records)
+            error("'" + path + "' has corrupted order of IDs");
+        return id(i);
+    };
+    auto it = lower_bound(byId, end, key, [&](uint64_t i, string_ref k){ return at(i) < k; });
+    vector<size_t> found;
+    for(; it != end && at(*it) == key; ++it)
+        found.push_back(*it);
+    return found;
+}
+
+vector<pair<size_t, size_t>> parseRanges(const string& spec)
+{
+    vector<pair<size_t, size_t>> ranges;
+    size_t pos = 0;
+    while(pos <= spec.size())
+    {
+        size_t comma = spec.find(',', pos);
+        if(comma == string::npos)
+            comma = spec.size();
+        string part = spec.substr(pos, comma - pos);
+        pos = comma + 1;
+        auto number = [&](const string& s){
+            if(s.empty() || s.find_first_not_of("0123456789") != string::npos || stoull(s) == 0)
+                error("bad record range '" + part + "', expected N, N-M or N-");
+            return (size_t)stoull(s);
+        };
+        size_t dash = part.find('-');
+        if(dash == string::npos)
+        {
+            size_t n = number(part);
+            ranges.push_back(make_pair(n - 1, n));
+            continue;
+        }
+        size_t first = number(part.substr(0, dash));
+        string tail = part.substr(dash + 1);
+        size_t last = tail.empty() ? numeric_limits<size_t>::max() : number(tail);
+        if(last < first)
+            error("bad record range '" + part + "', the end is before the start");
+        ranges.push_back(make_pair(first - 1, last));
+    }
+    return ranges;
+}
@@ -0,0 +1,74 @@
+// Sidecar index of an SDF file for picking records without scanning it,
+// see `fcss-2a index`
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include <stdint.h>
+#include <boost/utility/string_ref.hpp>
+#include "mapped.hpp"
+
+// Layout, native byte order, each section starts at a multiple of 8 bytes:
+//   header
+//   property - name of the ID property, empty if IDs were not indexed
+//   offsets  - (records + 1) uint64 record starts, the last one is the file size
+//   ids      - (records + 1) uint64 offsets of record IDs in 'values'
+//   byId     - records uint64 record numbers sorted by ID, file order for equal IDs
+//   values   - IDs back to back
+struct SdfIndexHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t propertyBytes;
+    uint64_t records;
+    uint64_t sourceSize;
+    uint64_t valueBytes;
+};
+
+// Collects record starts and IDs of an SDF file and writes them out as an index
+class SdfIndexWriter{
+public:
+    // 'idProp' is the property to look records up by, may be empty
+    explicit SdfIndexWriter(const std::string& idProp);
+    // records of uncompressed SDF text
+    void scan(const char* data, size_t size);
+    size_t size()const{ return offsets.size(); }
+    void write(std::ostream& out)const;
+private:
+    std::string property;
+    std::vector<uint64_t> offsets;
+    std::vector<uint64_t> ids;
+    std::string values;
+    uint64_t sourceSize;
+};
+
+// Read-only view of an index file
+class SdfIndex{
+public:
+    // throws std::logic_error if it's not a valid index
+    explicit SdfIndex(const std::string& path);
+    // index of 'sdf' as `fcss-2a index` names it
+    static std::string pathFor(const std::string& sdf);
+    size_t size()const{ return header->records; }
+    // ID property the index was made with, empty if there are no IDs
+    boost::string_ref property()const;
+    // record 'i' of 'data' (the indexed file), throws if the file
+    // doesn't look like the one that was indexed
+    boost::string_ref record(const char* data, size_t size, size_t i)const;
+    boost::string_ref id(size_t i)const;
+    // numbers of records with 'id' in file order
+    std::vector<size_t> find(boost::string_ref id)const;
+private:
+    MappedFile file;
+    std::string path;
+    const SdfIndexHeader* header;
+    const uint64_t* offsets;
+    const uint64_t* ids;
+    const uint64_t* byId;
+    const char* values;
+    const char* propertyName;
+};
+
+// 1-based inclusive record ranges like "1-100,250,1000-", an open end
+// means up to the last record, returned 0-based as [first, last)
+std::vector<std::pair<size_t, size_t>> parseRanges(const std::string& spec);
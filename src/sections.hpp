@@ -0,0 +1,49 @@
+// Binary files made of sections (corpus, SDF index, descriptor DB image):
+// native byte order, each section starts at a multiple of 8 bytes
+#pragma once
+#include <ostream>
+#include <stdint.h>
+
+inline uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~uint64_t(7);
+}
+
+// zeros after a section of 'size' bytes up to the start of the next one
+inline void pad(std::ostream& out, uint64_t size)
+{
+    static const char zeros[8] = {};
+    out.write(zeros, align8(size) - size);
+}
+
+// Offsets of sections one after another in a file of 'size' bytes.
+// Counts come from the header of the file and may be anything, a section
+// that can't fit in the file makes the layout invalid so that offsets
+// never wrap around
+class FileSections{
+public:
+    FileSections(uint64_t header, uint64_t size):
+        end(header), size(size), fits(header <= size){}
+
+    // start of 'count' + 'more' items of 'item' bytes, 'more' for fixed
+    // extra items such as an entry holding the totals
+    uint64_t section(uint64_t count, uint64_t item, uint64_t more = 0)
+    {
+        uint64_t start = align8(end);
+        uint64_t room = fits && start <= size ? (size - start) / item : 0;
+        if(!fits || count > room || more > room - count)
+        {
+            fits = false;
+            return 0;
+        }
+        end = start + (count + more) * item;
+        return start;
+    }
+
+    // all sections fit and the last one ends the file
+    bool exact()const{ return fits && end == size; }
+
+private:
+    uint64_t end, size;
+    bool fits;
+};
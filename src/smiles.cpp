@@ -0,0 +1,390 @@
+#include <vector>
+#include <string>
+#include <string.h>
+#include <boost/graph/max_cardinality_matching.hpp>
+#include "smiles.hpp"
+
+using namespace std;
+using boost::string_ref;
+
+void error(const string& msg);
+
+namespace {
+
+struct SmilesAtom{
+    Code code;
+    bool aromatic;
+    int hcount; // explicit in brackets
+};
+
+struct SmilesBound{
+    int a1, a2;
+    int type; // AROMATIC until kekulized
+};
+
+class SmilesParser{
+public:
+    SmilesParser(string_ref text): s(text), pos(0){}
+
+    void parse()
+    {
+        vector<int> branches; // stack of atoms to continue from after ')'
+        int prev = -1;
+        int bound = 0; // pending bound symbol, 0 if none
+        while(pos < s.size())
+        {
+            char c = s[pos];
+            if(c == '(')
+            {
+                if(prev < 0)
+                    fail("branch without an atom");
+                branches.push_back(prev);
+                pos++;
+            }
+            else if(c == ')')
+            {
+                if(branches.empty())
+                    fail("unbalanced ')'");
+                prev = branches.back();
+                branches.pop_back();
+                pos++;
+            }
+            else if(c == '.')
+            {
+                prev = -1;
+                pos++;
+            }
+            else if(bondSymbol(c))
+            {
+                if(bound)
+                    fail("two bounds in a row");
+                bound = bondType(c);
+                pos++;
+            }
+            else if(digit(c) || c == '%')
+            {
+                if(prev < 0)
+                    fail("ring closure without an atom");
+                ringClosure(prev, readRingNumber(), bound);
+                bound = 0;
+            }
+            else
+            {
+                int atom = c == '[' ? bracketAtom() : organicAtom();
+                if(prev >= 0)
+                    addBound(prev, atom, bound);
+                else if(bound)
+                    fail("bound without a preceding atom");
+                bound = 0;
+                prev = atom;
+            }
+        }
+        if(!branches.empty())
+            fail("unbalanced '('");
+        if(bound)
+            fail("bound without a following atom");
+        for(size_t i = 0; i < rings.size(); i++)
+            if(rings[i].atom >= 0)
+                fail("unclosed ring " + to_string(i));
+        if(atoms.empty())
+            fail("no atoms");
+    }
+
+    ChemGraph build()
+    {
+        kekulize();
+        ChemGraph graph(atoms.size());
+        for(size_t i = 0; i < atoms.size(); i++)
+            graph[i] = AtomVertex(atoms[i].code);
+        for(auto& b : bounds)
+            add_edge(b.a1, b.a2, Bound(b.type), graph);
+        return graph;
+    }
+
+private:
+    struct Ring{
+        int atom; // -1 if not open
+        int bound;
+    };
+
+    string_ref s;
+    size_t pos;
+    vector<SmilesAtom> atoms;
+    vector<SmilesBound> bounds;
+    vector<Ring> rings;
+
+    void fail(const string& msg)
+    {
+        error("SMILES at " + to_string(pos) + ": " + msg);
+    }
+
+    // ASCII only, <ctype.h> takes negative chars of other bytes badly
+    static bool digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool lower(char c)
+    {
+        return c >= 'a' && c <= 'z';
+    }
+
+    static bool upper(char c)
+    {
+        return c >= 'A' && c <= 'Z';
+    }
+
+    static char toUpper(char c)
+    {
+        return lower(c) ? c - 'a' + 'A' : c;
+    }
+
+    static bool bondSymbol(char c)
+    {
+        return c == '-' || c == '=' || c == '#' || c == '$' || c == ':' || c == '/' || c == '\\';
+    }
+
+    int bondType(char c)
+    {
+        switch(c){
+        case '=': return DOUBLE;
+        case '#': return TRIPPLE;
+        case ':': return AROMATIC;
+        case '$': fail("quadruple bounds are not supported");
+        default: return SINGLE; // '-' and cis/trans markers
+        }
+        return SINGLE;
+    }
+
+    int addAtom(const string& symbol, bool aromatic, int charge = 0, int hcount = 0)
+    {
+        Code code(symbol);
+        code.charge(charge);
+        atoms.push_back(SmilesAtom{code, aromatic, hcount});
+        return atoms.size() - 1;
+    }
+
+    void addBound(int a, int b, int type)
+    {
+        if(a == b)
+            fail("atom bound to itself");
+        for(auto& e : bounds)
+            if((e.a1 == a && e.a2 == b) || (e.a1 == b && e.a2 == a))
+                fail("duplicate bound");
+        // implicit bound between aromatic atoms is aromatic
+        if(!type)
+            type = atoms[a].aromatic && atoms[b].aromatic ? AROMATIC : SINGLE;
+        bounds.push_back(SmilesBound{a, b, type});
+    }
+
+    int organicAtom()
+    {
+        static const char* twoLetter[] = { "Cl", "Br" };
+        for(auto sym : twoLetter)
+        {
+            if(s.substr(pos, 2) == sym)
+            {
+                pos += 2;
+                return addAtom(sym, false);
+            }
+        }
+        char c = s[pos];
+        switch(c){
+        case 'B': case 'C': case 'N': case 'O': case 'P': case 'S': case 'F': case 'I':
+            pos++;
+            return addAtom(string(1, c), false);
+        case 'b': case 'c': case 'n': case 'o': case 'p': case 's':
+            pos++;
+            return addAtom(string(1, toUpper(c)), true);
+        case '*':
+            fail("wildcard atoms are not supported");
+        }
+        fail(string("unexpected '") + c + "'");
+        return -1;
+    }
+
+    // [isotope? symbol chiral? hcount? charge? class?]
+    int bracketAtom()
+    {
+        pos++; // '['
+        while(pos < s.size() && digit(s[pos]))
+            pos++;
+        if(pos >= s.size())
+            fail("unterminated bracket atom");
+        string symbol;
+        bool aromatic = false;
+        if(lower(s[pos]))
+        {
+            // aromatic: b c n o p s se as te
+            static const char* aromatics[] = { "se", "as", "te", "b", "c", "n", "o", "p", "s" };
+            for(auto a : aromatics)
+            {
+                if(s.substr(pos, strlen(a)) == a)
+                {
+                    symbol = a;
+                    break;
+                }
+            }
+            if(symbol.empty())
+                fail("unknown aromatic atom");
+            pos += symbol.size();
+            symbol[0] = toUpper(symbol[0]);
+            aromatic = true;
+        }
+        else if(upper(s[pos]))
+        {
+            symbol = s[pos++];
+            if(pos < s.size() && lower(s[pos]))
+                symbol += s[pos++];
+        }
+        else if(s[pos] == '*')
+            fail("wildcard atoms are not supported");
+        else
+            fail("expected atom symbol");
+        // chirality e.g. @, @@, @TH1, @SP2, @OH15
+        if(pos < s.size() && s[pos] == '@')
+        {
+            pos++;
+            if(pos < s.size() && s[pos] == '@')
+                pos++;
+            else if(pos + 1 < s.size() && upper(s[pos]) && upper(s[pos + 1]))
+            {
+                pos += 2;
+                while(pos < s.size() && digit(s[pos]))
+                    pos++;
+            }
+        }
+        int hcount = 0;
+        if(pos < s.size() && s[pos] == 'H')
+        {
+            pos++;
+            hcount = 1;
+            if(pos < s.size() && digit(s[pos]))
+                hcount = s[pos++] - '0';
+        }
+        int charge = 0;
+        if(pos < s.size() && (s[pos] == '+' || s[pos] == '-'))
+        {
+            char sign = s[pos];
+            int n = 0;
+            while(pos < s.size() && s[pos] == sign)
+            {
+                pos++;
+                n++;
+            }
+            if(n == 1 && pos < s.size() && digit(s[pos]))
+            {
+                n = 0;
+                while(pos < s.size() && digit(s[pos]))
+                    n = n * 10 + s[pos++] - '0';
+            }
+            charge = sign == '+' ? n : -n;
+        }
+        if(pos < s.size() && s[pos] == ':') // atom class
+        {
+            pos++;
+            while(pos < s.size() && digit(s[pos]))
+                pos++;
+        }
+        if(pos >= s.size() || s[pos] != ']')
+            fail("expected ']'");
+        pos++;
+        return addAtom(symbol, aromatic, charge, hcount);
+    }
+
+    int readRingNumber()
+    {
+        if(s[pos] != '%')
+            return s[pos++] - '0';
+        if(pos + 2 >= s.size() || !digit(s[pos + 1]) || !digit(s[pos + 2]))
+            fail("expected two digits after '%'");
+        int n = (s[pos + 1] - '0') * 10 + s[pos + 2] - '0';
+        pos += 3;
+        return n;
+    }
+
+    void ringClosure(int atom, int n, int bound)
+    {
+        if((int)rings.size() <= n)
+            rings.resize(n + 1, Ring{-1, 0});
+        Ring& r = rings[n];
+        if(r.atom < 0)
+        {
+            r.atom = atom;
+            r.bound = bound;
+            return;
+        }
+        if(bound && r.bound && bound != r.bound)
+            fail("conflicting bounds for ring " + to_string(n));
+        addBound(r.atom, atom, bound ? bound : r.bound);
+        r.atom = -1;
+    }
+
+    // an aromatic atom that has to get a double bound in Kekule form
+    bool needsDouble(int a, const vector<int>& degree, const vector<bool>& multiple)
+    {
+        auto& atom = atoms[a];
+        if(!atom.aromatic || multiple[a])
+            return false;
+        auto code = atom.code;
+        int charge = code.charge();
+        if(code == C || code == B)
+            return charge == 0;
+        if(code == N || code == P || code == As)
+        {
+            if(charge > 0)
+                return true;
+            return charge == 0 && atom.hcount == 0 && degree[a] == 2;
+        }
+        // O, S, Se, Te donate a lone pair unless charged
+        return charge > 0;
+    }
+
+    void kekulize()
+    {
+        vector<int> degree(atoms.size(), 0);
+        vector<bool> multiple(atoms.size(), false);
+        bool any = false;
+        for(auto& b : bounds)
+        {
+            degree[b.a1]++;
+            degree[b.a2]++;
+            if(b.type == DOUBLE || b.type == TRIPPLE)
+                multiple[b.a1] = multiple[b.a2] = true;
+            any = any || b.type == AROMATIC;
+        }
+        if(!any)
+            return;
+        typedef boost::adjacency_list<boost::vecS, boost::vecS, boost::undirectedS> Simple;
+        Simple pi(atoms.size());
+        int needed = 0;
+        vector<bool> needs(atoms.size());
+        for(size_t a = 0; a < atoms.size(); a++)
+        {
+            needs[a] = needsDouble(a, degree, multiple);
+            needed += needs[a];
+        }
+        for(auto& b : bounds)
+            if(b.type == AROMATIC && needs[b.a1] && needs[b.a2])
+                add_edge(b.a1, b.a2, pi);
+        vector<Simple::vertex_descriptor> mate(atoms.size());
+        edmonds_maximum_cardinality_matching(pi, &mate[0]);
+        if((int)matching_size(pi, &mate[0]) * 2 != needed)
+            error("SMILES: can't kekulize aromatic system");
+        for(auto& b : bounds)
+        {
+            if(b.type != AROMATIC)
+                continue;
+            b.type = needs[b.a1] && (int)mate[b.a1] == b.a2 ? DOUBLE : SINGLE;
+        }
+    }
+};
+
+}
+
+ChemGraph readSmiles(string_ref smiles)
+{
+    SmilesParser parser(smiles);
+    parser.parse();
+    return parser.build();
+}
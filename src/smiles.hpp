@@ -0,0 +1,11 @@
+// SMILES reader, builds ChemGraph without going through CTab
+#pragma once
+#include <boost/utility/string_ref.hpp>
+#include "chemgraph.hpp"
+
+// Supports organic subset and bracket atoms (isotope, chirality and
+// H count are accepted but ignored as hydrogens are added by FCSP),
+// charges, branches, ring closures including %nn and '.' for disconnected parts.
+// Aromatic atoms are kekulized into alternating SINGLE/DOUBLE bounds
+// the way MOL files have them, throws std::logic_error on malformed input
+ChemGraph readSmiles(boost::string_ref smiles);
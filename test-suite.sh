@@ -1,11 +1,54 @@
 #!/bin/bash
 LOG_LEVEL=3 # warn-s and worse
+# a corpus is a directory of MOL files, of multi-record SDF files or of SMILES files
 for t in tests/* ; do
 	echo "Encoding" `echo -n $t | sed -r 's|.*/(.*)|\1|'`
-	find $t/MOL/ -name '*.MOL' | sort | xargs ./fcss.sh -v ${LOG_LEVEL} --format=csv  > $t/fcss-2a-dev.csv
+	if [ -d $t/MOL ]; then
+		find $t/MOL/ -name '*.MOL' | sort | xargs ./fcss.sh -v ${LOG_LEVEL} --format=csv  > $t/fcss-2a-dev.csv
+	elif [ -d $t/SDF ]; then
+		# with ARGS records are picked through an index, e.g. --records or --ids
+		ARGS=
+		if [ -f $t/ARGS ]; then
+			find $t/SDF/ -name '*.sdf' | sort | xargs ./fcss.sh index -v ${LOG_LEVEL} --id ID
+			ARGS=`cat $t/ARGS`
+		fi
+		find $t/SDF/ -name '*.sdf' | sort | xargs ./fcss.sh -v ${LOG_LEVEL} --sdf --id ID ${ARGS} --format=csv  > $t/fcss-2a-dev.csv
+	elif [ -d $t/SMI ]; then
+		find $t/SMI/ -name '*.smi' | sort | xargs ./fcss.sh -v ${LOG_LEVEL} --smiles --format=csv  > $t/fcss-2a-dev.csv
+	fi
 done 2>test-suite.log
 
+# a MOL corpus packed with `fcss-2a pack` or with its files compressed
+# must encode the same as its MOL files
+COPIED=tests/benzenes
+VARIANTS="pack gzip"
+which zstd >/dev/null && VARIANTS="$VARIANTS zstd"
+TMP=`mktemp -d`
+for v in $VARIANTS ; do
+	echo "Encoding" `basename $COPIED` $v
+	if [ $v = pack ]; then
+		find $COPIED/MOL/ -name '*.MOL' | sort | xargs ./fcss.sh pack -v ${LOG_LEVEL} -o $TMP/corpus.pack
+		./fcss.sh -v ${LOG_LEVEL} --corpus --format=csv $TMP/corpus.pack > $COPIED/fcss-2a-$v.csv
+	else
+		# compression is told by contents, names stay as in the golden output
+		mkdir $TMP/$v
+		for f in `find $COPIED/MOL/ -name '*.MOL' | sort` ; do
+			$v -c $f > $TMP/$v/`basename $f`
+		done
+		find $TMP/$v/ -name '*.MOL' | sort | xargs ./fcss.sh -v ${LOG_LEVEL} --format=csv > $COPIED/fcss-2a-$v.csv
+	fi
+done 2>>test-suite.log
+rm -rf $TMP
+
+# corpora made after fcss-2 are compared to the last promoted output
 for t in tests/* ; do
 	echo "Comparing " `echo -n $t | sed -r 's|.*/(.*)|\1|'`
-	./fcss-comp -i $t/fcss-2.csv $t/fcss-2a-dev.csv | tee $t/diff.cmp | grep -A 5 "SUMMARY" | tail -3
+	BASE=$t/fcss-2.csv
+	[ -f $BASE ] || BASE=$t/fcss-2a.csv
+	./fcss-comp -i $BASE $t/fcss-2a-dev.csv | tee $t/diff.cmp | grep -A 5 "SUMMARY" | tail -3
+done
+# copies of a MOL corpus are compared to its golden output
+for v in $VARIANTS ; do
+	echo "Comparing " `basename $COPIED` $v
+	./fcss-comp $COPIED/fcss-2a.csv $COPIED/fcss-2a-$v.csv | tee $COPIED/diff-$v.cmp | grep -A 5 "SUMMARY" | tail -3
 done